@@ -0,0 +1,57 @@
+#pragma once
+#include "ir.hpp"
+#include <iterator>
+#include <map>
+
+inline bool isAddressArith(const Instruction& inst) {
+    return inst.op == OpType::GetElemPtr || inst.op == OpType::GetPtr;
+}
+
+// inst 是不是只把 addr 当地址用的 load/store
+inline bool isMemoryUserOf(const Instruction& inst, const Value* addr) {
+    if (inst.op == OpType::Load) {
+        return static_cast<const LoadInst&>(inst).address == addr;
+    }
+    if (inst.op == OpType::Store) {
+        const auto& store = static_cast<const StoreInst&>(inst);
+        return store.address == addr && store.value != addr;
+    }
+    return false;
+}
+
+// 只被同一块里的一条 load/store 当地址用的 getelemptr/getptr，挪到紧挨着使用者的前面
+// 这类指令不读内存，往后挪不改变语义；挪过去之后指令选择能把地址计算折进 lw/sw 的偏移，
+// 寄存器分配看到的下标和基址的活跃范围也正好延伸到访存的位置
+class AddressSinking {
+public:
+    bool run(Program& prog) {
+        bool changed = false;
+        for (auto& func : prog.funcs) {
+            changed |= run(*func);
+        }
+        return changed;
+    }
+
+    bool run(Function& func) {
+        std::map<const Value*, int> useCount;
+        for (const auto& block : func.blocks) {
+            for (const auto& inst : block->insts) {
+                for (Value* op : inst->operands()) useCount[op]++;
+            }
+        }
+        bool changed = false;
+        for (auto& block : func.blocks) {
+            auto& insts = block->insts;
+            for (auto it = insts.begin(); it != insts.end();) {
+                auto cur = it++;
+                if (!isAddressArith(**cur) || useCount[cur->get()] != 1) continue;
+                auto user = it;
+                while (user != insts.end() && !isMemoryUserOf(**user, cur->get())) ++user;
+                if (user == insts.end() || user == it) continue;
+                insts.splice(user, insts, cur);
+                changed = true;
+            }
+        }
+        return changed;
+    }
+};
@@ -0,0 +1,184 @@
+#pragma once
+#include "MachineIR.hpp"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+// 不依赖 profile 的块布局（Pettis-Hansen 式的链合并）
+//   边的权重 = 源块的估计频率（10^循环深度）× 分支概率，退出循环的边概率低
+//   按权重从大到小把边两端的链首尾相接，再把链排起来，入口链在最前
+// 布局之后删掉跳到下一块的 j，条件分支的目标正好是下一块时取反
+// 取反之后条件分支可能跳得比 ±4 KiB 还远，序言尾声和栈偏移都补完之后要再跑 relaxBranches
+class BlockLayout {
+public:
+    void run(MachineFunction& mf, const std::map<const MachineBasicBlock*, int>& depth) {
+        if (mf.blocks.size() > 1) {
+            placeBlocks(mf, depth);
+        }
+        removeFallthroughJumps(mf);
+    }
+
+    static MOpcode invertBranch(MOpcode op) {
+        switch (op) {
+            case MOpcode::BEQ:  return MOpcode::BNE;
+            case MOpcode::BNE:  return MOpcode::BEQ;
+            case MOpcode::BLT:  return MOpcode::BGE;
+            case MOpcode::BGE:  return MOpcode::BLT;
+            case MOpcode::BGT:  return MOpcode::BLE;
+            case MOpcode::BLE:  return MOpcode::BGT;
+            case MOpcode::BEQZ: return MOpcode::BNEZ;
+            default:            return MOpcode::BEQZ;  // BNEZ
+        }
+    }
+
+    // 目标超出条件分支范围的 bcond target 改成 b!cond skip; j target; skip: ...
+    // 按每条指令展开后最多的字节数估算距离，估出来够得着就一定够得着；改了之后代码变长，再算一遍
+    static void relaxBranches(MachineFunction& mf) {
+        int counter = 0;
+        for (bool changed = true; changed;) {
+            changed = false;
+            std::map<const MachineBasicBlock*, long> start;
+            long pc = 0;
+            for (const auto& block : mf.blocks) {
+                start[block.get()] = pc;
+                for (const auto& mi : block->insts) pc += maxSize(mi);
+            }
+            pc = 0;
+            for (auto it = mf.blocks.begin(); it != mf.blocks.end(); ++it) {
+                MachineBasicBlock* block = it->get();
+                for (auto mi = block->insts.begin(); mi != block->insts.end(); ++mi) {
+                    if (isCondBranch(*mi)) {
+                        long dist = start.at(mi->ops.back().block) - pc;
+                        if (dist < -4096 || dist > 4094) {
+                            auto skip = std::make_unique<MachineBasicBlock>(block->label + "_far_" + std::to_string(counter++));
+                            skip->insts.splice(skip->insts.end(), block->insts, std::next(mi), block->insts.end());
+                            MOperand target = mi->ops.back();
+                            mi->op = invertBranch(mi->op);
+                            mi->ops.back() = MOperand::label(skip.get());
+                            block->add(MOpcode::J, {target});
+                            it = mf.blocks.insert(std::next(it), std::move(skip));
+                            changed = true;
+                            break;
+                        }
+                    }
+                    pc += maxSize(*mi);
+                }
+            }
+        }
+    }
+
+private:
+    struct Edge {
+        int from, to;
+        double weight;
+    };
+
+    void placeBlocks(MachineFunction& mf, const std::map<const MachineBasicBlock*, int>& depth) {
+        MachineCFG cfg(mf);
+        int n = (int)cfg.blocks.size();
+        auto depthOf = [&](int b) {
+            auto found = depth.find(cfg.blocks[b]);
+            return found == depth.end() ? 0 : found->second;
+        };
+        auto freq = [&](int b) {
+            double w = 1;
+            for (int d = std::min(depthOf(b), 8); d > 0; --d) w *= 10;
+            return w;
+        };
+
+        std::vector<Edge> edges;
+        for (int b = 0; b < n; ++b) {
+            const auto& succs = cfg.succs[b];
+            int exits = 0;
+            for (int s : succs) {
+                if (depthOf(s) < depthOf(b)) exits++;
+            }
+            for (int s : succs) {
+                double prob = 1.0 / succs.size();
+                if (exits > 0 && exits < (int)succs.size()) {
+                    // 留在循环里的一边是热路径
+                    prob = depthOf(s) < depthOf(b) ? 0.1 / exits : 0.9 / (succs.size() - exits);
+                }
+                edges.push_back({b, s, freq(b) * prob});
+            }
+        }
+        std::stable_sort(edges.begin(), edges.end(), [](const Edge& x, const Edge& y) {
+            return x.weight > y.weight;
+        });
+
+        // chainOf[b]：b 所在链的编号；链用 vector 存块的顺序
+        std::vector<int> chainOf(n);
+        std::vector<std::vector<int>> chains(n);
+        for (int b = 0; b < n; ++b) {
+            chainOf[b] = b;
+            chains[b] = {b};
+        }
+        for (const Edge& e : edges) {
+            int a = chainOf[e.from], c = chainOf[e.to];
+            if (a == c || chains[a].back() != e.from || chains[c].front() != e.to || e.to == 0) {
+                continue;
+            }
+            for (int b : chains[c]) {
+                chainOf[b] = a;
+                chains[a].push_back(b);
+            }
+            chains[c].clear();
+        }
+
+        // 入口链在最前，其余的链按链首原来的位置
+        std::vector<int> order;
+        for (int c = 0; c < n; ++c) {
+            if (chains[c].empty()) continue;
+            if (chainOf[0] == c) {
+                order.insert(order.begin(), chains[c].begin(), chains[c].end());
+            } else {
+                order.insert(order.end(), chains[c].begin(), chains[c].end());
+            }
+        }
+
+        std::vector<std::unique_ptr<MachineBasicBlock>> owned;
+        for (auto& block : mf.blocks) owned.push_back(std::move(block));
+        mf.blocks.clear();
+        for (int b : order) mf.blocks.push_back(std::move(owned[b]));
+    }
+
+    static bool isCondBranch(const MachineInstr& mi) {
+        return mi.format() == MFormat::Branch || mi.format() == MFormat::BranchZ;
+    }
+
+    // 汇编器展开之后的字节数上限：li/la/call/tail 和按符号访问全局变量最多两条
+    static int maxSize(const MachineInstr& mi) {
+        switch (mi.format()) {
+            case MFormat::LoadImm:
+            case MFormat::LoadAddr:
+            case MFormat::LoadSym:
+            case MFormat::StoreSym:
+            case MFormat::Call:
+                return 8;
+            default:
+                return 4;
+        }
+    }
+
+    void removeFallthroughJumps(MachineFunction& mf) {
+        for (auto it = mf.blocks.begin(); it != mf.blocks.end(); ++it) {
+            auto nextIt = std::next(it);
+            MachineBasicBlock* next = nextIt == mf.blocks.end() ? nullptr : nextIt->get();
+            auto& insts = (*it)->insts;
+            if (insts.empty() || insts.back().op != MOpcode::J) continue;
+            auto jump = std::prev(insts.end());
+            if (jump->ops[0].block == next) {
+                insts.erase(jump);
+                continue;
+            }
+            if (insts.size() < 2) continue;
+            auto br = std::prev(jump);
+            if (isCondBranch(*br) && br->ops.back().block == next) {
+                // bcond next; j other  =>  b!cond other，落空到 next
+                br->op = invertBranch(br->op);
+                br->ops.back() = jump->ops[0];
+                insts.erase(jump);
+            }
+        }
+    }
+};
@@ -0,0 +1,259 @@
+#pragma once
+#include "ir.hpp"
+#include "Dominance.hpp"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 基于控制依赖的激进死代码删除（ADCE）：
+//   1. 一开始只有 ret、call 和会被读到的 store 是活的；活指令用到的值、活块控制依赖的 br
+//      （后支配边界上的块的终结指令）、活块参数的各个入边所在的块，依次变活
+//   2. 死的非终结指令和块参数删掉；死的 br 改成跳到它的直接后支配者，
+//      中间那段（包括没有副作用的循环）就走不到了，一并删掉
+//   3. 收拾 CFG：只有一条 jump 的空块让前驱直接跳过去，只有一个前驱的块接到前驱后面
+// 和通常的 ADCE 一样，默认没有副作用的循环总会结束
+class DeadCodeElimination {
+public:
+    bool run(Program& prog) {
+        bool changed = false;
+        for (auto& func : prog.funcs) {
+            changed |= run(*func);
+        }
+        return changed;
+    }
+
+    bool run(Function& func) {
+        if (func.blocks.empty()) return false;
+        bool changed = removeUnreachableBlocks(func);
+        changed |= sweep(func);
+        changed |= removeUnreachableBlocks(func);
+        changed |= simplifyCFG(func);
+        return changed;
+    }
+
+private:
+    std::unordered_set<const Instruction*> liveInsts;
+    std::unordered_set<const BlockArg*> liveArgs;
+    std::unordered_set<const BasicBlock*> liveBlocks;
+    std::vector<const Instruction*> work;
+    std::vector<const BlockArg*> argWork;
+    std::unordered_map<const Instruction*, BasicBlock*> parent;
+    std::unordered_map<const BasicBlock*, std::vector<JumpInst*>> incoming;
+    const PostDominatorTree* pdom = nullptr;
+
+    // 只写不读的局部数组：地址只用来算别的地址或者当 store 的地址，往里存的东西没人看
+    static std::unordered_set<const Value*> writeOnlyObjects(const Function& func) {
+        std::unordered_set<const Value*> objects, escaped;
+        for (const auto& block : func.blocks) {
+            for (const auto& inst : block->insts) {
+                if (inst->op == OpType::Alloc) objects.insert(inst.get());
+                auto ops = inst->operands();
+                for (size_t i = 0; i < ops.size(); ++i) {
+                    const Value* base = baseObject(ops[i]);
+                    if (inst->op == OpType::Store && i == 1) continue;
+                    if ((inst->op == OpType::GetElemPtr || inst->op == OpType::GetPtr) && i == 0) continue;
+                    escaped.insert(base);
+                }
+            }
+        }
+        for (const Value* v : escaped) objects.erase(v);
+        return objects;
+    }
+
+    void markInst(Instruction* inst) {
+        if (!liveInsts.insert(inst).second) return;
+        work.push_back(inst);
+        markBlock(parent.at(inst));
+    }
+
+    void markBlock(BasicBlock* block) {
+        if (!liveBlocks.insert(block).second) return;
+        int b = pdom->indexOf(block);
+        for (int c : pdom->frontier[b]) markInst(pdom->blocks[c]->insts.back().get());
+    }
+
+    void markValue(Value* v) {
+        if (auto arg = dynamic_cast<BlockArg*>(v)) {
+            if (liveArgs.insert(arg).second) argWork.push_back(arg);
+        } else if (auto inst = dynamic_cast<Instruction*>(v)) {
+            markInst(inst);
+        }
+    }
+
+    // 活块参数：每条入边所在的块和边上对应的实参都活
+    void propagate() {
+        while (!work.empty() || !argWork.empty()) {
+            if (!argWork.empty()) {
+                const BlockArg* arg = argWork.back();
+                argWork.pop_back();
+                const auto& args = arg->parent->args;
+                size_t i = std::find(args.begin(), args.end(), arg) - args.begin();
+                for (JumpInst* jump : incoming[arg->parent]) {
+                    markBlock(parent.at(jump));
+                    markValue(jump->args[i]);
+                }
+                continue;
+            }
+            const Instruction* inst = work.back();
+            work.pop_back();
+            if (inst->op == OpType::Jump) continue;  // 实参跟着目标的块参数走
+            for (Value* op : inst->operands()) markValue(op);
+        }
+    }
+
+    // 死的 br 改跳到哪：直接后支配者；是虚拟出口（比如两边都是死循环）就只能留着
+    BasicBlock* bypassTarget(BasicBlock* block) const {
+        int b = pdom->indexOf(block);
+        return pdom->blocks[pdom->idom[b]];
+    }
+
+    bool sweep(Function& func) {
+        PostDominatorTree tree(func);
+        pdom = &tree;
+        liveInsts.clear();
+        liveArgs.clear();
+        liveBlocks.clear();
+        parent.clear();
+        incoming.clear();
+
+        auto writeOnly = writeOnlyObjects(func);
+        for (auto& block : func.blocks) {
+            for (auto& inst : block->insts) {
+                parent[inst.get()] = block.get();
+                if (inst->op == OpType::Jump) {
+                    auto jump = static_cast<JumpInst*>(inst.get());
+                    incoming[jump->targetBlock].push_back(jump);
+                }
+            }
+        }
+        for (auto& block : func.blocks) {
+            for (auto& inst : block->insts) {
+                bool root = inst->op == OpType::Ret || inst->op == OpType::Call ||
+                            (inst->op == OpType::Store &&
+                             !writeOnly.count(baseObject(static_cast<StoreInst*>(inst.get())->address)));
+                if (root) markInst(inst.get());
+            }
+        }
+        propagate();
+        // 绕不过去的死 br 只能留下，它的条件也就活了
+        for (bool again = true; again;) {
+            again = false;
+            for (auto& block : func.blocks) {
+                Instruction* term = block->insts.back().get();
+                if (term->op != OpType::Br || liveInsts.count(term)) continue;
+                BasicBlock* target = bypassTarget(block.get());
+                bool blocked = !target || std::any_of(target->args.begin(), target->args.end(),
+                    [&](const BlockArg* arg) { return liveArgs.count(arg) > 0; });
+                if (!blocked) continue;
+                markInst(term);
+                propagate();
+                again = true;
+            }
+        }
+
+        bool changed = false;
+        for (auto& block : func.blocks) {
+            auto& insts = block->insts;
+            for (auto it = insts.begin(); it != std::prev(insts.end());) {
+                if (liveInsts.count(it->get())) { ++it; continue; }
+                it = insts.erase(it);
+                changed = true;
+            }
+            auto& args = block->args;
+            for (size_t i = args.size(); i-- > 0;) {
+                if (liveArgs.count(args[i])) continue;
+                for (JumpInst* jump : incoming[block.get()]) jump->args.erase(jump->args.begin() + i);
+                args.erase(args.begin() + i);
+                changed = true;
+            }
+        }
+        bool redirected = false;
+        for (auto& block : func.blocks) {
+            Instruction* term = block->insts.back().get();
+            if (term->op != OpType::Br || liveInsts.count(term)) continue;
+            block->insts.back().reset(new JumpInst(bypassTarget(block.get())));
+            redirected = true;
+        }
+        if (redirected) func.invalidateCFG();
+        pdom = nullptr;
+        return changed || redirected;
+    }
+
+    // 空块短路、单前驱的块合并，做到不动为止
+    bool simplifyCFG(Function& func) {
+        BasicBlock* entry = func.blocks.front().get();
+        std::unordered_set<const BasicBlock*> removed;
+        std::unordered_map<const Value*, Value*> replaced;
+        func.updateCFG();
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (auto& ptr : func.blocks) {
+                BasicBlock* block = ptr.get();
+                if (removed.count(block)) continue;
+                // 以 jump 结尾、目标只有这一个前驱：目标的指令接过来，块参数换成实参
+                while (block->insts.back()->op == OpType::Jump) {
+                    auto jump = static_cast<JumpInst*>(block->insts.back().get());
+                    BasicBlock* next = jump->targetBlock;
+                    if (next == block || next == entry || next->preds.size() != 1) break;
+                    for (size_t i = 0; i < next->args.size(); ++i) replaced[next->args[i]] = jump->args[i];
+                    block->insts.pop_back();
+                    block->insts.splice(block->insts.end(), next->insts);
+                    block->values.splice(block->values.end(), next->values);
+                    block->succs = next->succs;
+                    for (BasicBlock* s : next->succs) std::replace(s->preds.begin(), s->preds.end(), next, block);
+                    next->args.clear();
+                    next->preds.clear();
+                    next->succs.clear();
+                    removed.insert(next);
+                    changed = true;
+                }
+                // 只有一条不带实参的 jump：前驱直接跳到目标
+                if (block == entry || !block->args.empty() || block->insts.size() != 1) continue;
+                if (block->insts.back()->op != OpType::Jump) continue;
+                auto jump = static_cast<JumpInst*>(block->insts.back().get());
+                if (!jump->args.empty() || jump->targetBlock == block) continue;
+                BasicBlock* target = jump->targetBlock;
+                auto preds = block->preds;
+                for (BasicBlock* p : preds) {
+                    func.replaceSuccessor(p, block, target);
+                    foldSameTargetBranch(p);
+                }
+                target->preds.erase(std::find(target->preds.begin(), target->preds.end(), block));
+                block->preds.clear();
+                block->succs.clear();
+                entry->values.splice(entry->values.end(), block->values);
+                removed.insert(block);
+                changed = true;
+            }
+        }
+        if (removed.empty()) return false;
+
+        func.blocks.remove_if([&](const std::unique_ptr<BasicBlock>& block) { return removed.count(block.get()) > 0; });
+        auto resolve = [&](Value* v) {
+            for (auto r = replaced.find(v); r != replaced.end(); r = replaced.find(v)) v = r->second;
+            return v;
+        };
+        for (auto& block : func.blocks) {
+            for (auto& inst : block->insts) {
+                for (Value* op : inst->operands()) {
+                    if (replaced.count(op)) inst->replaceOperand(op, resolve(op));
+                }
+            }
+        }
+        func.invalidateCFG();
+        return true;
+    }
+
+    // 两边跳到同一个地方的 br 换成 jump；边表里那两条重复的边留一条
+    static void foldSameTargetBranch(BasicBlock* block) {
+        Instruction* term = block->insts.back().get();
+        if (term->op != OpType::Br) return;
+        auto br = static_cast<BranchInst*>(term);
+        if (br->thenBlock != br->elseBlock || !br->thenArgs.empty() || !br->elseArgs.empty()) return;
+        BasicBlock* target = br->thenBlock;
+        block->insts.back().reset(new JumpInst(target));
+        block->succs = {target};
+        target->preds.erase(std::find(target->preds.begin(), target->preds.end(), block));
+    }
+};
@@ -0,0 +1,228 @@
+#pragma once
+#include "ir.hpp"
+#include <unordered_map>
+#include <vector>
+
+// 支配树的公共部分：图按从根出发的逆后序编号（根是 0，走不到的点不在里面），
+// 用 Cooper-Harvey-Kennedy 的迭代算法求 idom，再求支配边界
+// 建好之后函数的 CFG 又改过（Function::cfgEpoch 变了），stale() 返回 true，需要重建
+class DomTreeBase {
+public:
+    std::vector<BasicBlock*> blocks;               // 按编号排的块
+    std::vector<std::vector<int>> preds, succs;    // 分析方向上的前驱/后继
+    std::vector<int> idom;                         // 根的 idom 是它自己
+    std::vector<std::vector<int>> children;        // 支配树上的孩子
+    std::vector<std::vector<int>> frontier;        // 支配边界
+
+    int size() const { return (int)blocks.size(); }
+
+    // 不在图里的块返回 -1
+    int indexOf(const BasicBlock* block) const {
+        auto it = index.find(block);
+        return it == index.end() ? -1 : it->second;
+    }
+
+    bool dominates(int a, int b) const {
+        return pre[a] <= pre[b] && post[b] <= post[a];
+    }
+
+    bool stale(const Function& func) const { return func.cfgEpoch != epoch; }
+
+protected:
+    unsigned epoch = 0;
+    std::unordered_map<const BasicBlock*, int> index;
+    std::vector<int> pre, post;  // 支配树上的先序/后序编号
+
+    // nodes[i] 的后继是 edges[i]，nodes[root] 是根
+    void build(const std::vector<BasicBlock*>& nodes, const std::vector<std::vector<int>>& edges, int root) {
+        numberNodes(nodes, edges, root);
+        computeIdom();
+        computeFrontier();
+    }
+
+private:
+    void numberNodes(const std::vector<BasicBlock*>& nodes, const std::vector<std::vector<int>>& edges, int root) {
+        int total = (int)nodes.size();
+        std::vector<int> postorder;
+        std::vector<char> visited(total, 0);
+        std::vector<std::pair<int, size_t>> stack{{root, 0}};
+        visited[root] = 1;
+        while (!stack.empty()) {
+            auto& top = stack.back();
+            if (top.second == edges[top.first].size()) {
+                postorder.push_back(top.first);
+                stack.pop_back();
+                continue;
+            }
+            int next = edges[top.first][top.second++];
+            if (!visited[next]) {
+                visited[next] = 1;
+                stack.push_back({next, 0});
+            }
+        }
+
+        int n = (int)postorder.size();
+        std::vector<int> number(total, -1);
+        for (int i = 0; i < n; ++i) number[postorder[n - 1 - i]] = i;
+        blocks.assign(n, nullptr);
+        preds.assign(n, {});
+        succs.assign(n, {});
+        for (int raw = 0; raw < total; ++raw) {
+            int b = number[raw];
+            if (b < 0) continue;
+            blocks[b] = nodes[raw];
+            if (nodes[raw]) index[nodes[raw]] = b;
+            for (int t : edges[raw]) {
+                succs[b].push_back(number[t]);
+                preds[number[t]].push_back(b);
+            }
+        }
+    }
+
+    void computeIdom() {
+        int n = size();
+        idom.assign(n, -1);
+        idom[0] = 0;
+        // 逆后序里 idom 的编号总比自己小，两个指针轮流往上走到相遇
+        auto intersect = [&](int a, int b) {
+            while (a != b) {
+                while (a > b) a = idom[a];
+                while (b > a) b = idom[b];
+            }
+            return a;
+        };
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (int b = 1; b < n; ++b) {
+                int newIdom = -1;
+                for (int p : preds[b]) {
+                    if (idom[p] < 0) continue;
+                    newIdom = newIdom < 0 ? p : intersect(p, newIdom);
+                }
+                if (newIdom != idom[b]) {
+                    idom[b] = newIdom;
+                    changed = true;
+                }
+            }
+        }
+
+        children.assign(n, {});
+        for (int b = 1; b < n; ++b) children[idom[b]].push_back(b);
+        pre.assign(n, 0);
+        post.assign(n, 0);
+        int preCount = 0, postCount = 0;
+        std::vector<std::pair<int, size_t>> stack{{0, 0}};
+        pre[0] = preCount++;
+        while (!stack.empty()) {
+            auto& top = stack.back();
+            if (top.second == children[top.first].size()) {
+                post[top.first] = postCount++;
+                stack.pop_back();
+                continue;
+            }
+            int c = children[top.first][top.second++];
+            pre[c] = preCount++;
+            stack.push_back({c, 0});
+        }
+    }
+
+    // 汇合点 b 的每个前驱沿 idom 往上走到 idom(b) 为止，路上的块的支配边界都有 b
+    void computeFrontier() {
+        int n = size();
+        frontier.assign(n, {});
+        for (int b = 0; b < n; ++b) {
+            if (preds[b].size() < 2) continue;
+            for (int p : preds[b]) {
+                for (int runner = p; runner != idom[b]; runner = idom[runner]) {
+                    auto& df = frontier[runner];
+                    if (df.empty() || df.back() != b) df.push_back(b);
+                    if (runner == 0) break;
+                }
+            }
+        }
+    }
+};
+
+// 支配树：根是入口，入口走不到的块不在里面
+class DominatorTree : public DomTreeBase {
+public:
+    explicit DominatorTree(Function& func) {
+        epoch = func.cfgEpoch;
+        if (func.blocks.empty()) return;
+        func.updateCFG();
+        std::vector<BasicBlock*> nodes;
+        std::unordered_map<const BasicBlock*, int> raw;
+        for (auto& block : func.blocks) {
+            raw[block.get()] = (int)nodes.size();
+            nodes.push_back(block.get());
+        }
+        std::vector<std::vector<int>> edges(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            for (BasicBlock* s : nodes[i]->succs) edges[i].push_back(raw.at(s));
+        }
+        build(nodes, edges, 0);
+    }
+};
+
+// 后支配树：在反向 CFG 上求支配，根是一个虚拟出口（blocks[0] == nullptr），所有 ret 块连向它
+// 死循环里的块反向走不到出口，从它们里挑一个也连上虚拟出口，这样每个块都在树里
+// 后支配边界就是控制依赖：b 控制依赖于 frontier[b] 里那些块的分支
+class PostDominatorTree : public DomTreeBase {
+public:
+    explicit PostDominatorTree(Function& func) {
+        epoch = func.cfgEpoch;
+        if (func.blocks.empty()) return;
+        func.updateCFG();
+        std::vector<BasicBlock*> nodes;
+        std::unordered_map<const BasicBlock*, int> raw;
+        for (auto& block : func.blocks) {
+            raw[block.get()] = (int)nodes.size();
+            nodes.push_back(block.get());
+        }
+        int exit = (int)nodes.size();
+        nodes.push_back(nullptr);
+        std::vector<std::vector<int>> edges(nodes.size());
+        for (int i = 0; i < exit; ++i) {
+            if (nodes[i]->succs.empty()) edges[exit].push_back(i);
+            for (BasicBlock* p : nodes[i]->preds) edges[i].push_back(raw.at(p));
+        }
+
+        // 从出口反向标记，剩下没标到的从靠后的块开始补边
+        std::vector<char> reached(nodes.size(), 0);
+        std::vector<int> work{exit};
+        reached[exit] = 1;
+        auto flood = [&]() {
+            while (!work.empty()) {
+                int b = work.back();
+                work.pop_back();
+                for (int t : edges[b]) {
+                    if (!reached[t]) {
+                        reached[t] = 1;
+                        work.push_back(t);
+                    }
+                }
+            }
+        };
+        flood();
+        for (int i = exit - 1; i >= 0; --i) {
+            if (reached[i]) continue;
+            edges[exit].push_back(i);
+            reached[i] = 1;
+            work.push_back(i);
+            flood();
+        }
+        build(nodes, edges, exit);
+    }
+};
+
+// 删掉入口走不到的块，返回有没有删
+inline bool removeUnreachableBlocks(Function& func) {
+    DominatorTree dom(func);
+    if (dom.size() == (int)func.blocks.size()) return false;
+    std::vector<BasicBlock*> dead;
+    for (auto& block : func.blocks) {
+        if (dom.indexOf(block.get()) < 0) dead.push_back(block.get());
+    }
+    for (BasicBlock* block : dead) func.removeBlock(block);
+    return true;
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include "ir.hpp"
+#include "Dominance.hpp"
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 两个对象的内存会不会重叠：不同的 alloc / 全局变量互不相干，
+// 数组参数是调用者给的，不会指到本函数的 alloc，但可能是任何全局变量或者别的参数
+inline bool mayAlias(const Value* a, const Value* b) {
+    if (a == b) return true;
+    auto isObject = [](const Value* v) {
+        auto inst = dynamic_cast<const Instruction*>(v);
+        return (inst && inst->op == OpType::Alloc) || dynamic_cast<const GlobalAlloc*>(v);
+    };
+    auto isAlloc = [](const Value* v) {
+        auto inst = dynamic_cast<const Instruction*>(v);
+        return inst && inst->op == OpType::Alloc;
+    };
+    if (isObject(a) && isObject(b)) return false;
+    return !isAlloc(a) && !isAlloc(b);
+}
+
+// 基于支配树的全局值编号：沿支配树先序遍历，作用域哈希表里记着支配当前块的表达式
+//   二元运算、getelemptr、getptr：同样的运算和操作数已经算过，就换成之前的结果
+//   load：同一地址上一次 load/store 之后没有可能重叠的 store 和 call，就换成那个值
+// load 表只在只有一个前驱的块里沿用父亲的，汇合点和循环头清空
+class GVN {
+public:
+    bool run(Program& prog) {
+        bool changed = false;
+        for (auto& func : prog.funcs) {
+            changed |= run(*func);
+        }
+        return changed;
+    }
+
+    bool run(Function& func) {
+        if (func.blocks.empty()) return false;
+        DominatorTree dom(func);
+        exprs.clear();
+        replaced.clear();
+        bool changed = false;
+
+        std::vector<std::vector<Key>> scoped(dom.size());
+        std::vector<LoadTable> loads(dom.size());
+        std::vector<std::pair<int, size_t>> stack{{0, 0}};
+        changed |= visitBlock(dom.blocks[0], scoped[0], loads[0]);
+        while (!stack.empty()) {
+            auto& frame = stack.back();
+            int b = frame.first;
+            if (frame.second == dom.children[b].size()) {
+                for (const Key& key : scoped[b]) exprs.erase(key);
+                scoped[b].clear();
+                loads[b].clear();
+                stack.pop_back();
+                continue;
+            }
+            int c = dom.children[b][frame.second++];
+            if (dom.preds[c].size() == 1) loads[c] = loads[b];
+            changed |= visitBlock(dom.blocks[c], scoped[c], loads[c]);
+            stack.push_back({c, 0});
+        }
+        return changed;
+    }
+
+private:
+    // 常数按值比较，其余的值按对象比较
+    using ValueKey = std::pair<const Value*, int>;
+    using Key = std::tuple<int, ValueKey, ValueKey>;
+    struct AvailableLoad {
+        Value* value;
+        const Value* base;
+    };
+    using LoadTable = std::unordered_map<const Value*, AvailableLoad>;  // 地址 -> 那里现在的值
+
+    std::map<Key, Value*> exprs;
+    std::unordered_map<const Value*, Value*> replaced;
+
+    static ValueKey keyOf(const Value* v) {
+        if (auto c = dynamic_cast<const Integer*>(v)) return {nullptr, c->value};
+        return {v, 0};
+    }
+
+    // 交换律的运算把操作数排好序，a > b 统一成 b < a
+    static Key keyOf(OpType op, const Value* lhs, const Value* rhs) {
+        ValueKey l = keyOf(lhs), r = keyOf(rhs);
+        switch (op) {
+            case OpType::Gt: op = OpType::Lt; std::swap(l, r); break;
+            case OpType::Ge: op = OpType::Le; std::swap(l, r); break;
+            case OpType::Add: case OpType::Mul: case OpType::Eq: case OpType::Ne:
+            case OpType::AND: case OpType::OR:
+                if (r < l) std::swap(l, r);
+                break;
+            default: break;
+        }
+        return Key{(int)op, l, r};
+    }
+
+    static void killAliasing(LoadTable& loads, const Value* base) {
+        for (auto it = loads.begin(); it != loads.end();) {
+            if (mayAlias(it->second.base, base)) it = loads.erase(it);
+            else ++it;
+        }
+    }
+
+    bool visitBlock(BasicBlock* block, std::vector<Key>& scoped, LoadTable& loads) {
+        bool changed = false;
+        for (auto it = block->insts.begin(); it != block->insts.end();) {
+            Instruction* inst = it->get();
+            for (Value* op : inst->operands()) {
+                auto r = replaced.find(op);
+                if (r != replaced.end()) inst->replaceOperand(op, r->second);
+            }
+
+            Value* leader = nullptr;
+            if (auto binary = dynamic_cast<Binary*>(inst)) {
+                leader = lookup(keyOf(binary->op, binary->lhs, binary->rhs), inst, scoped);
+            } else if (auto gep = dynamic_cast<GetElemPtrInst*>(inst)) {
+                leader = lookup(keyOf(OpType::GetElemPtr, gep->ptr, gep->index), inst, scoped);
+            } else if (auto gp = dynamic_cast<GetPtrInst*>(inst)) {
+                leader = lookup(keyOf(OpType::GetPtr, gp->ptr, gp->index), inst, scoped);
+            } else if (inst->op == OpType::Load) {
+                auto load = static_cast<LoadInst*>(inst);
+                auto found = loads.find(load->address);
+                if (found != loads.end()) {
+                    leader = found->second.value;
+                } else {
+                    loads[load->address] = {load, baseObject(load->address)};
+                }
+            } else if (inst->op == OpType::Store) {
+                auto store = static_cast<StoreInst*>(inst);
+                const Value* base = baseObject(store->address);
+                killAliasing(loads, base);
+                loads[store->address] = {store->value, base};
+            } else if (inst->op == OpType::Call) {
+                loads.clear();
+            }
+
+            if (leader) {
+                replaced[inst] = leader;
+                it = block->insts.erase(it);
+                changed = true;
+                continue;
+            }
+            ++it;
+        }
+        return changed;
+    }
+
+    // 表里已经有就返回之前的值，没有就把 inst 记进当前作用域
+    Value* lookup(const Key& key, Instruction* inst, std::vector<Key>& scoped) {
+        auto found = exprs.find(key);
+        if (found != exprs.end()) return found->second;
+        exprs[key] = inst;
+        scoped.push_back(key);
+        return nullptr;
+    }
+};
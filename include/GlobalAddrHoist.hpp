@@ -0,0 +1,138 @@
+#pragma once
+#include "MachineIR.hpp"
+#include "RegAlloc.hpp"
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
+#include <vector>
+
+// 循环里反复 la 同一个全局数组的基址：在循环外 la 一次，放进循环里没人碰的寄存器，
+// 循环里的 la 删掉，之后对它结果的使用改成那个寄存器
+//   循环由外往内处理，外层放得下的 la 内层就看不到了
+//   寄存器：循环里的指令都不读写它（包括 call 隐式写的 caller-saved），进循环头时也不活跃；
+//   循环里有 call 时只能用 s 寄存器，没用过的 s 寄存器多出的一对保存/恢复只在序言和尾声里
+//   循环头在循环外的前驱都只能走到循环头，la 就放在它们最后的 j 前面
+class GlobalAddressHoisting {
+public:
+    // 返回循环外放了 la 的全局符号个数
+    int run(MachineFunction& mf) {
+        MachineCFG cfg(mf);
+        MachineDominators dom(cfg);
+        int n = (int)cfg.blocks.size();
+
+        // 同一个循环头的回边合并成一个循环
+        std::map<int, std::set<int>> loops;
+        for (int b = 0; b < n; ++b) {
+            for (int h : cfg.succs[b]) {
+                if (!dom.dominates(h, b)) continue;
+                auto& body = loops[h];
+                body.insert(h);
+                std::vector<int> work;
+                if (body.insert(b).second) work.push_back(b);
+                while (!work.empty()) {
+                    int x = work.back();
+                    work.pop_back();
+                    for (int p : cfg.preds[x]) {
+                        if (dom.reachable(p) && body.insert(p).second) work.push_back(p);
+                    }
+                }
+            }
+        }
+        std::vector<std::pair<int, const std::set<int>*>> order;
+        for (const auto& loop : loops) order.push_back({loop.first, &loop.second});
+        std::stable_sort(order.begin(), order.end(), [](const auto& x, const auto& y) {
+            return x.second->size() > y.second->size();
+        });
+
+        std::vector<int> pool;
+        for (const auto& name : allocatableRegs()) pool.push_back(regByName(name));
+
+        int hoisted = 0;
+        for (const auto& loop : order) {
+            int header = loop.first;
+            const std::set<int>& body = *loop.second;
+            std::vector<int> entries;
+            bool ok = true;
+            for (int p : cfg.preds[header]) {
+                if (body.count(p)) continue;
+                entries.push_back(p);
+                ok &= cfg.succs[p].size() == 1;
+            }
+            if (!ok || entries.empty()) continue;
+
+            std::vector<std::string> symbols;
+            for (int b : body) {
+                for (const auto& mi : cfg.blocks[b]->insts) {
+                    if (mi.op == MOpcode::LA && std::find(symbols.begin(), symbols.end(), mi.ops[1].symbol) == symbols.end()) {
+                        symbols.push_back(mi.ops[1].symbol);
+                    }
+                }
+            }
+            for (const auto& symbol : symbols) {
+                RegLiveness live(cfg, explicitUseMask);
+                RegMask busy = live.liveIn[header];
+                bool hasCall = false;
+                for (int b : body) {
+                    for (const auto& mi : cfg.blocks[b]->insts) {
+                        busy |= defMask(mi) | explicitUseMask(mi);
+                        hasCall |= mi.op == MOpcode::CALL;
+                    }
+                }
+                int reg = NoReg;
+                for (int r : pool) {
+                    if (busy & regBit(r)) continue;
+                    if (hasCall && !(calleeSavedMask() & regBit(r))) continue;
+                    reg = r;
+                    break;
+                }
+                if (reg == NoReg) break;
+
+                for (int p : entries) {
+                    auto& insts = cfg.blocks[p]->insts;
+                    auto pos = !insts.empty() && insts.back().op == MOpcode::J ? std::prev(insts.end()) : insts.end();
+                    insts.insert(pos, MachineInstr(MOpcode::LA, {MOperand::reg(reg), MOperand::sym(symbol)}));
+                }
+                for (int b : body) {
+                    replaceLoads(*cfg.blocks[b], symbol, reg, live.liveOut[b]);
+                }
+                hoisted++;
+            }
+        }
+        return hoisted;
+    }
+
+private:
+    // 把块里的 la t, symbol 换成对 reg 的使用；t 之后还被隐式使用或者活跃到块外时留一条 mv
+    static void replaceLoads(MachineBasicBlock& block, const std::string& symbol, int reg, RegMask liveOut) {
+        auto& insts = block.insts;
+        for (auto it = insts.begin(); it != insts.end();) {
+            auto la = it++;
+            if (la->op != MOpcode::LA || la->ops[1].symbol != symbol) continue;
+            int t = la->ops[0].value;
+            bool keep = (liveOut & regBit(t)) != 0;
+            for (auto next = it; next != insts.end(); ++next) {
+                bool explicitUse = false;
+                for (size_t i = 0; i < next->ops.size(); ++i) {
+                    if (next->ops[i].isReg() && next->ops[i].value == t && !isDefOperand(*next, i)) {
+                        next->ops[i].value = reg;
+                        explicitUse = true;
+                    }
+                }
+                if ((useMask(*next) & regBit(t)) && !explicitUse) {
+                    keep = true;
+                    break;
+                }
+                if (defMask(*next) & regBit(t)) {
+                    keep = false;
+                    break;
+                }
+            }
+            if (keep) {
+                *la = MachineInstr(MOpcode::MV, {MOperand::reg(t), MOperand::reg(reg)});
+            } else {
+                insts.erase(la);
+            }
+        }
+    }
+};
@@ -2,6 +2,7 @@
 #include "ast.hpp" 
 #include "ir.hpp"  
 #include <cassert> 
+#include <functional>
 #include "SymbolTable.hpp"
 #include "flatten.hpp"
 class IRGenerator {
@@ -37,6 +38,77 @@ private:
         lastInst->op == OpType::Ret;
     }
 
+    // 0 的个数不少于这么多时，局部数组先用循环整块清零；循环每轮清 kZeroFillUnroll 个元素
+    static constexpr int kZeroFillLoopMin = 16;
+    static constexpr int kZeroFillUnroll = 4;
+
+    void storeElement(AllocInst* allocInst, int index, int value) {
+        auto gep = new GetElemPtrInst(allocInst, new Integer(index), newTemp());
+        currentBlock->addInst(gep);
+        currentBlock->addInst(new StoreInst(new Integer(value), gep));
+    }
+
+    // 局部数组的初始化：0 少时逐个元素 store；0 多时先清零再只 store 非 0 的元素
+    // 运行库里没有 memset，清零用一个展开过的小循环
+    void storeArrayInit(AllocInst* allocInst, int size, const SparseInit& values) {
+        int filled = 0;  // [0, filled) 已经被循环清零
+        if (size - (int)values.size() >= kZeroFillLoopMin) {
+            filled = size / kZeroFillUnroll * kZeroFillUnroll;
+            emitZeroFill(allocInst, filled);
+        }
+        size_t next = 0;
+        for (; next < values.size() && values[next].first < filled; ++next) {
+            storeElement(allocInst, values[next].first, values[next].second);
+        }
+        for (int i = filled; i < size; ++i) {
+            int value = 0;
+            if (next < values.size() && values[next].first == i) {
+                value = values[next++].second;
+            }
+            storeElement(allocInst, i, value);
+        }
+    }
+
+    // 把数组的前 limit 个元素清零，limit 是 kZeroFillUnroll 的正整数倍：
+    //   store 0, @i
+    // %zero_fill:
+    //   %p = getelemptr @arr, %i
+    //   store 0, %p[0..kZeroFillUnroll)      // getptr %p, k
+    //   %i' = add %i, kZeroFillUnroll; store %i', @i
+    //   br %i' < limit, %zero_fill, %zero_fill_end
+    void emitZeroFill(AllocInst* allocInst, int limit) {
+        auto counter = new AllocInst(sym_table.makeUniqueName("zero_fill_i"));
+        currentBlock->addInst(counter);
+        auto zero = new Integer(0);
+        currentBlock->addValue(zero);
+        currentBlock->addInst(new StoreInst(zero, counter));
+
+        auto loopBlock = new BasicBlock(newBlockLabel("zero_fill"));
+        auto endBlock = new BasicBlock(newBlockLabel("zero_fill_end"));
+        currentBlock->addInst(new JumpInst(loopBlock));
+        currentFunc->addBlock(loopBlock);
+        currentBlock = loopBlock;
+
+        auto index = new LoadInst(counter, newTemp());
+        currentBlock->addInst(index);
+        auto row = new GetElemPtrInst(allocInst, index, newTemp());
+        currentBlock->addInst(row);
+        for (int k = 0; k < kZeroFillUnroll; ++k) {
+            auto elem = new GetPtrInst(row, new Integer(k), newTemp());
+            currentBlock->addInst(elem);
+            currentBlock->addInst(new StoreInst(zero, elem));
+        }
+        auto nextIndex = new Binary(OpType::Add, index, new Integer(kZeroFillUnroll), newTemp());
+        currentBlock->addInst(nextIndex);
+        currentBlock->addInst(new StoreInst(nextIndex, counter));
+        auto cond = new Binary(OpType::Lt, nextIndex, new Integer(limit), newTemp());
+        currentBlock->addInst(cond);
+        currentBlock->addInst(new BranchInst(cond, loopBlock, endBlock));
+
+        currentFunc->addBlock(endBlock);
+        currentBlock = endBlock;
+    }
+
     // 辅助函数：处理函数参数值
     Value* emitArgValue(ExpAST* arg) {
         visit(*arg);
@@ -49,6 +121,7 @@ public:
     void setupLibraryFunctions() {
         auto addLib = [&](const std::string& name, Type ret, std::vector<Type> params = {}) {
             sym_table.insertFunc(name, ret, params);
+            sym_table.reserveName(name);
             program->decls.push_back({"@" + name, ret, params});
         };
 
@@ -69,6 +142,7 @@ public:
     }
 
 void visit(CompUnitAST* ast){
+    reserveGlobalNames(ast);
     for (auto &item : ast->items) {
     if (auto func_ptr = dynamic_cast<FuncDefAST*>(item.get())) {
         visit(*func_ptr);
@@ -79,6 +153,25 @@ void visit(CompUnitAST* ast){
 }
 }
 
+// 先把所有顶层的名字占上，后面生成的名字（比如提升出来的局部常量数组）不会和它们撞
+void reserveGlobalNames(CompUnitAST* ast) {
+    for (auto &item : ast->items) {
+        if (auto func_ptr = dynamic_cast<FuncDefAST*>(item.get())) {
+            sym_table.reserveName(func_ptr->ident);
+        } else if (auto decl_ptr = dynamic_cast<DeclAST*>(item.get())) {
+            if (decl_ptr->const_decl) {
+                for (auto& def : static_cast<ConstDeclAST*>(decl_ptr->const_decl.get())->const_defs) {
+                    sym_table.reserveName(static_cast<ConstDefAST*>(def.get())->ident);
+                }
+            } else if (decl_ptr->var_decl) {
+                for (auto& def : static_cast<VarDeclAST*>(decl_ptr->var_decl.get())->var_defs) {
+                    sym_table.reserveName(static_cast<VarDefAST*>(def.get())->ident);
+                }
+            }
+        }
+    }
+}
+
 void visitGlobalDecl(DeclAST* ast) {
     //全局常量 const int a,b...;
     if (ast->const_decl) {
@@ -92,14 +185,14 @@ void visitGlobalDecl(DeclAST* ast) {
             }
             int size = 1;
             for (int d : dims) size *= d;
-            std::vector<int> values;
             auto* init_ast = static_cast<ConstInitValAST*>(def->const_init_val.get());
-            values = flatten_const_init(init_ast, dims, sym_table);
+            SparseInit values = flatten_const_init(init_ast, dims, sym_table);
 
                 //生成 IR 里的全局分配对象
-                auto gConst = std::make_unique<GlobalAlloc>("@" + def->ident, values, size);
-                //存入符号表：记住名字、地址和长度
-                sym_table.insertConstArray(def->ident, gConst.get(), size, dims);
+                auto gConst = std::make_unique<GlobalAlloc>("@" + def->ident, std::move(values), size);
+                gConst->isConst = true;
+                //存入符号表：记住名字、地址、长度和初始值
+                sym_table.insertConstArray(def->ident, gConst.get(), size, dims, &gConst->values);
                 //存入程序集：确保最后打印 IR 时会有这一行 global 定义
                 program->globalValues.push_back(std::move(gConst));
             } 
@@ -128,15 +221,13 @@ void visitGlobalDecl(DeclAST* ast) {
                 size *= d;
             }
 
-            std::vector<int> values;
+            SparseInit values;  // 没有初始值时为空，即全 0
             if (def->init_val) {
                 auto* init_ast = static_cast<InitValAST*>(def->init_val.get());
                 values = flatten_init(init_ast, dims, sym_table);
-            } else {
-                values.assign(size, 0);
             }
 
-            auto gVar = std::make_unique<GlobalAlloc>("@" + def->ident, values, size);
+            auto gVar = std::make_unique<GlobalAlloc>("@" + def->ident, std::move(values), size);
             sym_table.insertVar(def->ident, gVar.get(), true, size, dims);
             program->globalValues.push_back(std::move(gVar));
         } 
@@ -264,18 +355,14 @@ void visit(FuncDefAST& ast) {
         }
 
         auto* init_ast = static_cast<ConstInitValAST*>(ast.const_init_val.get());
-        std::vector<int> values = flatten_const_init(init_ast, dims, sym_table);
-
-        auto allocInst = new AllocInst(sym_table.makeUniqueName(ast.ident), size);
-        currentBlock->addInst(allocInst);
-
-        for (int i = 0; i < size; ++i) {
-            auto gep = new GetElemPtrInst(allocInst, new Integer(i), newTemp());
-            currentBlock->addInst(gep);
-            currentBlock->addInst(new StoreInst(new Integer(values[i]), gep));
-        }
-
-        sym_table.insertConstArray(ast.ident, allocInst, size, dims);
+        SparseInit values = flatten_const_init(init_ast, dims, sym_table);
+
+        // 局部常量数组的内容不会变，提升成只读的全局数组，不用每次进函数都重新填一遍
+        std::string globalName = sym_table.makeUniqueName(currentFunc->name.substr(1) + "_" + ast.ident);
+        auto gConst = std::make_unique<GlobalAlloc>(globalName, std::move(values), size);
+        gConst->isConst = true;
+        sym_table.insertConstArray(ast.ident, gConst.get(), size, dims, &gConst->values);
+        program->globalValues.push_back(std::move(gConst));
     } else {
         auto const_init_val = static_cast<ConstInitValAST*>(ast.const_init_val.get());
         int value = const_init_val->evalConst(sym_table);
@@ -314,19 +401,12 @@ void visit(FuncDefAST& ast) {
         currentBlock->addInst(allocInst);
         sym_table.insertVar(ast.ident, allocInst, true, size, dims);
 
-        std::vector<int> values;
+        SparseInit values;
         if (ast.init_val) {
             auto* init = static_cast<InitValAST*>(ast.init_val.get());
             values = flatten_init(init, dims, sym_table);
-        } else {
-            values.assign(size, 0);
-        }
-
-        for (int i = 0; i < size; ++i) {
-            auto gep = new GetElemPtrInst(allocInst, new Integer(i), newTemp());
-            currentBlock->addInst(gep);
-            currentBlock->addInst(new StoreInst(new Integer(values[i]), gep));
         }
+        storeArrayInit(allocInst, size, values);
     } 
     else {
         auto allocInst = new AllocInst(uniqueName);
@@ -520,17 +600,12 @@ void visit(FuncDefAST& ast) {
                 }
             case StmtAST::StmtType::IfThen://if (Exp) Stmt
                 {   
-                    //计算 Exp
-                    visit (*static_cast<ExpAST*>(ast.exp.get()));
-                    Value* condition=lastVal;
-
                     //创建 then 和 end 块
                     auto thenBlock=new BasicBlock(newBlockLabel("then"));
                     auto endBlock=new BasicBlock(newBlockLabel("end"));
 
-                    //添加条件分支
-                    auto brInst=new BranchInst(condition, thenBlock, endBlock);
-                    currentBlock->addInst(brInst);
+                    //条件直接翻译成跳转
+                    genCond(*static_cast<ExpAST*>(ast.exp.get()), thenBlock, endBlock);
 
                     //处理 then 块
                     currentFunc->addBlock(thenBlock);
@@ -551,18 +626,13 @@ void visit(FuncDefAST& ast) {
                 }
             case StmtAST::StmtType::IfElse://if(Exp)Stmt else Stmt
                 {
-                    //计算 Exp
-                    visit (*static_cast<ExpAST*>(ast.exp.get()));
-                    Value* condition=lastVal;
-
                     //创建 then、else 和 end 块
                     auto thenBlock=new BasicBlock(newBlockLabel("then"));
                     auto elseBlock=new BasicBlock(newBlockLabel("else"));
                     auto endBlock=new BasicBlock(newBlockLabel("end"));
 
-                    //添加条件分支
-                    auto brInst=new BranchInst(condition, thenBlock, elseBlock);
-                    currentBlock->addInst(brInst);
+                    //条件直接翻译成跳转
+                    genCond(*static_cast<ExpAST*>(ast.exp.get()), thenBlock, elseBlock);
 
                     //处理 then 块
                     currentFunc->addBlock(thenBlock);
@@ -598,10 +668,7 @@ void visit(FuncDefAST& ast) {
             currentBlock->addInst(new JumpInst(condBlock));
             currentFunc->addBlock(condBlock);
             currentBlock = condBlock;
-            visit(*static_cast<ExpAST*>(ast.exp.get()));
-            Value* condition = lastVal;
-
-            currentBlock->addInst(new BranchInst(condition, bodyBlock, endBlock));
+            genCond(*static_cast<ExpAST*>(ast.exp.get()), bodyBlock, endBlock);
             loopStack.push_back({condBlock, endBlock});
 
             currentFunc->addBlock(bodyBlock);
@@ -703,6 +770,111 @@ void visit(FuncDefAST& ast) {
             }
         }
     }
+    // ---------- 条件的短路求值 ----------
+    // 作为 if/while 条件的表达式直接翻译成跳转：为真跳到 trueBlock，为假跳到 falseBlock
+    //   a || b：a 真直接去 trueBlock，否则在 lor_next 里再看 b
+    //   a && b：a 假直接去 falseBlock，否则在 land_right 里再看 b
+    //   !x 交换两个目标，(x) 往里看；其余的叶子算出值以后 br
+    // 生成完 currentBlock 已经有终止指令
+    void genCond(ExpAST& ast, BasicBlock* trueBlock, BasicBlock* falseBlock) {
+        genCond(*static_cast<LOrExpAST*>(ast.lor_exp.get()), trueBlock, falseBlock);
+    }
+
+    void genCond(LOrExpAST& ast, BasicBlock* trueBlock, BasicBlock* falseBlock) {
+        if (!ast.lor_exp) {
+            genCond(*static_cast<LAndExpAST*>(ast.land_exp.get()), trueBlock, falseBlock);
+            return;
+        }
+        auto nextBlock = new BasicBlock(newBlockLabel("lor_next"));
+        genCond(*static_cast<LOrExpAST*>(ast.lor_exp.get()), trueBlock, nextBlock);
+        currentFunc->addBlock(nextBlock);
+        currentBlock = nextBlock;
+        genCond(*static_cast<LAndExpAST*>(ast.land_exp.get()), trueBlock, falseBlock);
+    }
+
+    void genCond(LAndExpAST& ast, BasicBlock* trueBlock, BasicBlock* falseBlock) {
+        if (!ast.land_exp) {
+            genCondLeaf(*static_cast<EqExpAST*>(ast.eq_exp.get()), trueBlock, falseBlock);
+            return;
+        }
+        auto rightBlock = new BasicBlock(newBlockLabel("land_right"));
+        genCond(*static_cast<LAndExpAST*>(ast.land_exp.get()), rightBlock, falseBlock);
+        currentFunc->addBlock(rightBlock);
+        currentBlock = rightBlock;
+        genCondLeaf(*static_cast<EqExpAST*>(ast.eq_exp.get()), trueBlock, falseBlock);
+    }
+
+    // 沿着只有一个孩子的链往下找到一元表达式；链上有二元运算时返回 nullptr
+    static UnaryExpAST* asUnary(EqExpAST& ast) {
+        if (ast.eq_exp) return nullptr;
+        auto rel = static_cast<RelExpAST*>(ast.rel_exp.get());
+        if (rel->rel_exp) return nullptr;
+        auto add = static_cast<AddExpAST*>(rel->add_exp.get());
+        if (add->add_exp) return nullptr;
+        auto mul = static_cast<MulExpAST*>(add->mul_exp.get());
+        if (mul->mul_exp) return nullptr;
+        return static_cast<UnaryExpAST*>(mul->unary_exp.get());
+    }
+
+    void genCondLeaf(EqExpAST& ast, BasicBlock* trueBlock, BasicBlock* falseBlock) {
+        bool negate = false;
+        Value* value = nullptr;
+        UnaryExpAST* unary = asUnary(ast);
+        while (unary && unary->type == UnaryExpAST::UnaryType::Op &&
+               (unary->unary_op == '!' || unary->unary_op == '+')) {
+            negate ^= unary->unary_op == '!';
+            unary = static_cast<UnaryExpAST*>(unary->unary_exp.get());
+        }
+        if (unary && unary->type == UnaryExpAST::UnaryType::Primary) {
+            auto primary = static_cast<PrimaryExpAST*>(unary->primary_exp.get());
+            if (primary->exp) {
+                if (negate) std::swap(trueBlock, falseBlock);
+                genCond(*static_cast<ExpAST*>(primary->exp.get()), trueBlock, falseBlock);
+                return;
+            }
+        }
+        if (unary) {
+            visit(*unary);
+        } else {
+            visit(ast);
+        }
+        value = lastVal;
+        if (negate) std::swap(trueBlock, falseBlock);
+
+        // 常量条件直接跳过去
+        if (auto constant = dynamic_cast<Integer*>(value)) {
+            currentBlock->addInst(new JumpInst(constant->value ? trueBlock : falseBlock));
+            return;
+        }
+        currentBlock->addInst(new BranchInst(value, trueBlock, falseBlock));
+    }
+
+    // 逻辑表达式当值用时：先存 0，条件为真的路径上改存 1，汇合后读出来
+    void genLogicValue(std::function<void(BasicBlock*, BasicBlock*)> cond, const std::string& prefix) {
+        auto resultAlloc = new AllocInst(sym_table.makeUniqueName(prefix + "_result"));
+        currentBlock->addInst(resultAlloc);
+        auto zero = new Integer(0);
+        currentBlock->addValue(zero);
+        currentBlock->addInst(new StoreInst(zero, resultAlloc));
+
+        auto trueBlock = new BasicBlock(newBlockLabel(prefix + "_true"));
+        auto endBlock = new BasicBlock(newBlockLabel(prefix + "_end"));
+        cond(trueBlock, endBlock);
+
+        currentFunc->addBlock(trueBlock);
+        currentBlock = trueBlock;
+        auto one = new Integer(1);
+        currentBlock->addValue(one);
+        currentBlock->addInst(new StoreInst(one, resultAlloc));
+        currentBlock->addInst(new JumpInst(endBlock));
+
+        currentFunc->addBlock(endBlock);
+        currentBlock = endBlock;
+        auto finalRes = new LoadInst(resultAlloc, newTemp());
+        currentBlock->addInst(finalRes);
+        lastVal = finalRes;
+    }
+
     void visit(LAndExpAST& ast){
         if(ast.eq_exp && !ast.land_exp){
             // 基础情形：LAndExp -> EqExp
@@ -711,64 +883,9 @@ void visit(FuncDefAST& ast) {
             visit(*eqExp);
         }
         else if(ast.land_exp && ast.eq_exp){
-            // a && b
-            //int result=0;
-            //if(a !=0 ){
-            //   result=(b !=0);
-            //   }  
-
-            //@land_result = alloc i32
-            auto resultAlloc = new AllocInst(sym_table.makeUniqueName("land_result"));   
-            currentBlock->addInst(resultAlloc);
-            
-            //%0 = load @a
-            visit(*static_cast<LAndExpAST*>(ast.land_exp.get()));
-            Value* left = lastVal;
-
-            //%1 = ne %0, 0
-            auto zero = new Integer(0);
-            currentBlock->addValue(zero);
-            auto lhs_bool =new Binary(OpType::Ne, left, zero, newTemp());
-            currentBlock->addInst(lhs_bool);
-
-            //store 0, @land_result
-            auto storeZero = new StoreInst(zero, resultAlloc);
-            currentBlock->addInst(storeZero);
-
-            //创建 rightBlock 和 endBlock
-            auto rightBlock=new BasicBlock(newBlockLabel("land_right"));
-            auto endBlock=new BasicBlock(newBlockLabel("land_end"));
-
-            // 条件分支：left 真 -> rightBlock；left 假 -> endBlock（短路）。
-            auto brInst=new BranchInst(lhs_bool, rightBlock, endBlock);
-            currentBlock->addInst(brInst);
-
-            //处理 rightBlock
-            currentFunc->addBlock(rightBlock);
-            currentBlock=rightBlock;
-            visit(*static_cast<EqExpAST*>(ast.eq_exp.get()));
-            Value* right = lastVal;
-
-            //%2 = load @b
-            auto rhs_bool = new Binary(OpType::Ne, right, zero, newTemp());
-            currentBlock->addInst(rhs_bool);
-
-            //%3 = ne %2, 0
-            auto storeRhs=new StoreInst(rhs_bool, resultAlloc);
-            currentBlock->addInst(storeRhs);
-            
-            // rightBlock 结束后跳转到汇合块。
-            currentBlock->addInst(new JumpInst(endBlock));
-
-            //生成并切换到汇合块。
-            currentFunc->addBlock(endBlock);
-            currentBlock = endBlock;
-
-            // 读取最终结果，作为整个 && 表达式的值。
-            auto finalRes = new LoadInst(resultAlloc, newTemp());
-            currentBlock->addInst(finalRes);
-            lastVal = finalRes;
-            }
+            // a && b 当值用
+            genLogicValue([&](BasicBlock* t, BasicBlock* f) { genCond(ast, t, f); }, "land");
+        }
     }
     void visit(LOrExpAST& ast){
         if(ast.land_exp && !ast.lor_exp){
@@ -776,51 +893,8 @@ void visit(FuncDefAST& ast) {
             visit(*landExp);
         }
         else if(ast.lor_exp && ast.land_exp){
-            // a || b
-            //int result=1;
-            //if(a ==0 ){
-            //   result=(b !=0);
-            //   }
-            auto resultAlloc = new AllocInst(sym_table.makeUniqueName("lor_result"));   
-            currentBlock->addInst(resultAlloc);
-
-            visit(*static_cast<LOrExpAST*>(ast.lor_exp.get()));
-            Value* left = lastVal;
-
-            auto zero = new Integer(0);
-            currentBlock->addValue(zero);
-            auto lhs_bool =new Binary(OpType::Ne, left, zero, newTemp());
-            currentBlock->addInst(lhs_bool);
-
-            auto one = new Integer(1);
-            currentBlock->addValue(one);
-            currentBlock->addInst(new StoreInst(one, resultAlloc));
-
-            auto nextBlock=new BasicBlock(newBlockLabel("lor_next"));
-            auto endBlock=new BasicBlock(newBlockLabel("lor_end"));
-
-            auto brInst=new BranchInst(lhs_bool, endBlock, nextBlock);
-            currentBlock->addInst(brInst);
-
-
-            currentFunc->addBlock(nextBlock);
-            currentBlock=nextBlock;
-            visit(*static_cast<LAndExpAST*>(ast.land_exp.get()));
-            Value* right = lastVal;
-
-            auto rhs_bool = new Binary(OpType::Ne, right, zero, newTemp());
-            currentBlock->addInst(rhs_bool);
-            auto storeRhs=new StoreInst(rhs_bool, resultAlloc);
-            currentBlock->addInst(storeRhs);
-            currentBlock->addInst(new JumpInst(endBlock));
-            currentFunc->addBlock(endBlock);
-            currentBlock = endBlock;
-
-            auto finalRes = new LoadInst(resultAlloc, newTemp());
-            currentBlock->addInst(finalRes);
-            lastVal = finalRes;
-
-            
+            // a || b 当值用
+            genLogicValue([&](BasicBlock* t, BasicBlock* f) { genCond(ast, t, f); }, "lor");
         }
     }
 
@@ -952,6 +1026,16 @@ void visit(FuncDefAST& ast) {
             return;
         }
 
+        // 常量数组用常量下标取元素：直接得到立即数，不生成 getelemptr/load
+        if (info.kind == SymbolInfo::CONST && info.is_array && lval->indices.size() == info.array_dims.size()) {
+            try {
+                lastVal = new Integer(lval->evalConst(sym_table));
+                return;
+            } catch (const std::runtime_error&) {
+                // 下标不是常量（或越界），照常生成访存
+            }
+        }
+
         // ---------- Lv9.3: 数组参数 ----------
         if (info.is_param_array) {
             // 数组参数本身就是指针值
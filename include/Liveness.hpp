@@ -0,0 +1,271 @@
+#pragma once
+#include "ir.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 能放进寄存器的值：有结果的非 alloc 指令，以及函数参数和块参数
+inline bool isRegCandidate(const Value* v) {
+    if (dynamic_cast<const Parameter*>(v) || dynamic_cast<const BlockArg*>(v)) {
+        return true;
+    }
+    auto inst = dynamic_cast<const Instruction*>(v);
+    if (!inst || inst->op == OpType::Alloc) {
+        return false;
+    }
+    return inst->type == Type::Int32 || inst->type == Type::Pointer;
+}
+
+// 定长位集合，活跃分析的 live-in/live-out 都用它
+class BitSet {
+public:
+    BitSet() = default;
+    explicit BitSet(int n) : bits((n + 63) / 64, 0) {}
+
+    void set(int i) { bits[i >> 6] |= (uint64_t)1 << (i & 63); }
+    void reset(int i) { bits[i >> 6] &= ~((uint64_t)1 << (i & 63)); }
+    bool test(int i) const { return (bits[i >> 6] >> (i & 63)) & 1; }
+
+    // 并上 other，返回自己有没有变
+    bool unionWith(const BitSet& other) {
+        bool changed = false;
+        for (size_t i = 0; i < bits.size(); ++i) {
+            uint64_t merged = bits[i] | other.bits[i];
+            changed |= merged != bits[i];
+            bits[i] = merged;
+        }
+        return changed;
+    }
+
+    // this = use ∪ (out - def)，返回有没有变
+    bool assignTransfer(const BitSet& use, const BitSet& out, const BitSet& def) {
+        bool changed = false;
+        for (size_t i = 0; i < bits.size(); ++i) {
+            uint64_t next = use.bits[i] | (out.bits[i] & ~def.bits[i]);
+            changed |= next != bits[i];
+            bits[i] = next;
+        }
+        return changed;
+    }
+
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t i = 0; i < bits.size(); ++i) {
+            uint64_t word = bits[i];
+            while (word) {
+                int bit = __builtin_ctzll(word);
+                f((int)(i * 64 + bit));
+                word &= word - 1;
+            }
+        }
+    }
+
+private:
+    std::vector<uint64_t> bits;
+};
+
+// 一个值的活跃范围：若干个不相交的闭区间，按位置升序
+// 位置编号：线性顺序下第 i 条指令在 2i 读操作数、在 2i+1 写结果，参数在 -1 处定义
+struct LiveRange {
+    std::vector<std::pair<int, int>> segments;
+
+    bool empty() const { return segments.empty(); }
+    int start() const { return segments.front().first; }
+    int end() const { return segments.back().second; }
+
+    bool liveAt(int pos) const {
+        auto it = std::upper_bound(segments.begin(), segments.end(), std::make_pair(pos, INT32_MAX));
+        return it != segments.begin() && std::prev(it)->second >= pos;
+    }
+
+    bool overlaps(const LiveRange& other) const {
+        size_t i = 0, j = 0;
+        while (i < segments.size() && j < other.segments.size()) {
+            const auto& a = segments[i];
+            const auto& b = other.segments[j];
+            if (a.second < b.first) ++i;
+            else if (b.second < a.first) ++j;
+            else return true;
+        }
+        return false;
+    }
+};
+
+// 函数级活跃分析：块级 live-in/live-out 用工作表在 CFG 上迭代，
+// 再按线性顺序给每个值建立带空洞的活跃范围
+// 块参数在块首定义（位置 blockStart，早于块里第一条指令读操作数，这样它会跨过块首的 call），
+// 前驱跳转时传的实参算作跳转指令的使用
+class Liveness {
+public:
+    explicit Liveness(const Function& func) {
+        numberValues(func);
+        solve();
+        buildRanges();
+    }
+
+    int numValues() const { return (int)values.size(); }
+    int numBlocks() const { return (int)blocks.size(); }
+    const Value* value(int id) const { return values[id]; }
+    const BasicBlock* block(int b) const { return blocks[b]; }
+    const LiveRange& range(int id) const { return ranges[id]; }
+
+    // 不参与分析的值返回 -1
+    int idOf(const Value* v) const {
+        auto it = valueId.find(v);
+        return it == valueId.end() ? -1 : it->second;
+    }
+    int blockIndex(const BasicBlock* b) const { return blockId.at(b); }
+
+    const BitSet& liveIn(int b) const { return in[b]; }
+    const BitSet& liveOut(int b) const { return out[b]; }
+
+    // 线性顺序里的指令，位置 2i 对应 linearOrder()[i]
+    const std::vector<const Instruction*>& linearOrder() const { return order; }
+    int blockStart(int b) const { return 2 * firstInst[b] - 1; }
+    int blockEnd(int b) const { return 2 * (firstInst[b] + (int)blocks[b]->insts.size()) - 1; }
+
+    const std::vector<int>& predecessors(int b) const { return preds[b]; }
+    const std::vector<int>& successors(int b) const { return succs[b]; }
+
+private:
+    std::vector<const Value*> values;
+    std::unordered_map<const Value*, int> valueId;
+    std::vector<const BasicBlock*> blocks;
+    std::unordered_map<const BasicBlock*, int> blockId;
+    std::vector<std::vector<int>> preds, succs;
+    std::vector<BitSet> use, def, in, out;
+    std::vector<const Instruction*> order;
+    std::vector<int> firstInst;
+    std::vector<LiveRange> ranges;
+
+    int addValue(const Value* v) {
+        auto it = valueId.find(v);
+        if (it != valueId.end()) {
+            return it->second;
+        }
+        int id = (int)values.size();
+        valueId[v] = id;
+        values.push_back(v);
+        return id;
+    }
+
+    void numberValues(const Function& func) {
+        for (const auto& block : func.blocks) {
+            blockId[block.get()] = (int)blocks.size();
+            blocks.push_back(block.get());
+        }
+        for (const auto& block : func.blocks) {
+            firstInst.push_back((int)order.size());
+            for (BlockArg* arg : block->args) addValue(arg);
+            for (const auto& inst : block->insts) {
+                order.push_back(inst.get());
+                for (Value* op : inst->operands()) {
+                    if (isRegCandidate(op)) addValue(op);
+                }
+                if (isRegCandidate(inst.get())) addValue(inst.get());
+            }
+        }
+        int n = (int)blocks.size();
+        preds.assign(n, {});
+        succs.assign(n, {});
+        for (int b = 0; b < n; ++b) {
+            for (BasicBlock* s : successorsOf(*blocks[b])) {
+                auto it = blockId.find(s);
+                if (it == blockId.end()) continue;
+                succs[b].push_back(it->second);
+                preds[it->second].push_back(b);
+            }
+        }
+    }
+
+    void solve() {
+        int n = (int)blocks.size();
+        int m = (int)values.size();
+        use.assign(n, BitSet(m));
+        def.assign(n, BitSet(m));
+        in.assign(n, BitSet(m));
+        out.assign(n, BitSet(m));
+        for (int b = 0; b < n; ++b) {
+            for (BlockArg* arg : blocks[b]->args) def[b].set(idOf(arg));
+            for (const auto& inst : blocks[b]->insts) {
+                for (Value* op : inst->operands()) {
+                    int id = idOf(op);
+                    if (id >= 0 && !def[b].test(id)) use[b].set(id);
+                }
+                int id = idOf(inst.get());
+                if (id >= 0) def[b].set(id);
+            }
+        }
+
+        // 逆序放进工作表，一般几轮就收敛
+        std::vector<int> worklist;
+        std::vector<char> queued(n, 1);
+        for (int b = 0; b < n; ++b) worklist.push_back(b);
+        while (!worklist.empty()) {
+            int b = worklist.back();
+            worklist.pop_back();
+            queued[b] = 0;
+            for (int s : succs[b]) out[b].unionWith(in[s]);
+            if (in[b].assignTransfer(use[b], out[b], def[b])) {
+                for (int p : preds[b]) {
+                    if (!queued[p]) {
+                        queued[p] = 1;
+                        worklist.push_back(p);
+                    }
+                }
+            }
+        }
+    }
+
+    // Wimmer 的区间构造：逆序走每个块，live-out 先覆盖整块，遇到定义截断，遇到使用补到块首
+    void buildRanges() {
+        int m = (int)values.size();
+        std::vector<std::vector<std::pair<int, int>>> raw(m);
+        auto addSegment = [&](int id, int from, int to) {
+            auto& segs = raw[id];
+            // 逆序构造，新段总在前面，能接上就合并
+            if (!segs.empty() && segs.back().first <= to + 1 && from <= segs.back().second) {
+                segs.back().first = std::min(segs.back().first, from);
+                segs.back().second = std::max(segs.back().second, to);
+                return;
+            }
+            segs.push_back({from, to});
+        };
+        for (int b = (int)blocks.size() - 1; b >= 0; --b) {
+            int from = blockStart(b), to = blockEnd(b);
+            out[b].forEach([&](int id) { addSegment(id, from, to); });
+            int pos = 2 * (firstInst[b] + (int)blocks[b]->insts.size() - 1);
+            for (auto it = blocks[b]->insts.rbegin(); it != blocks[b]->insts.rend(); ++it, pos -= 2) {
+                int d = idOf(it->get());
+                if (d >= 0) {
+                    auto& segs = raw[d];
+                    if (!segs.empty() && segs.back().first <= pos + 1 && segs.back().second >= pos + 1) {
+                        segs.back().first = pos + 1;
+                    } else {
+                        segs.push_back({pos + 1, pos + 1});  // 定义了但没用到
+                    }
+                }
+                for (Value* op : (*it)->operands()) {
+                    int id = idOf(op);
+                    if (id >= 0) addSegment(id, from, pos);
+                }
+            }
+        }
+        ranges.assign(m, {});
+        for (int id = 0; id < m; ++id) {
+            auto& segs = raw[id];
+            std::sort(segs.begin(), segs.end());
+            for (const auto& seg : segs) {
+                auto& result = ranges[id].segments;
+                if (!result.empty() && seg.first <= result.back().second + 1) {
+                    result.back().second = std::max(result.back().second, seg.second);
+                } else {
+                    result.push_back(seg);
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,503 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+机器级 IR，介于 Koopa IR 和汇编文本之间
+MachineFunction
+MachineBasicBlock
+MachineInstr
+    - 操作数：寄存器 / 立即数 / frame index / 基本块 / 符号
+*/
+
+// RISC-V 整数寄存器，值就是 x 编号
+enum Reg : int {
+    ZERO = 0, RA = 1, SP = 2, GP = 3, TP = 4,
+    T0 = 5, T1 = 6, T2 = 7,
+    S0 = 8, S1 = 9,
+    A0 = 10, A1 = 11, A2 = 12, A3 = 13, A4 = 14, A5 = 15, A6 = 16, A7 = 17,
+    S2 = 18, S3 = 19, S4 = 20, S5 = 21, S6 = 22, S7 = 23, S8 = 24, S9 = 25, S10 = 26, S11 = 27,
+    T3 = 28, T4 = 29, T5 = 30, T6 = 31,
+    NoReg = -1
+};
+
+inline const char* regName(int r) {
+    static const char* names[32] = {
+        "x0", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1",
+        "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7",
+        "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11",
+        "t3", "t4", "t5", "t6"
+    };
+    return names[r];
+}
+
+inline int regByName(const std::string& name) {
+    for (int r = 0; r < 32; ++r) {
+        if (name == regName(r)) return r;
+    }
+    return NoReg;
+}
+
+inline int argReg(int i) { return A0 + i; }
+
+enum class MOpcode {
+    LI, LA, MV,
+    LW, SW, LWG, SWG,
+    ADD, SUB, MUL, DIV, REM, SLT, SGT, XOR, AND, OR, SLL, SRL, SRA, MULH,
+    ADDI, SLTI, XORI, ANDI, ORI, SLLI, SRLI, SRAI,
+    SEQZ, SNEZ, NEG,
+    BEQ, BNE, BLT, BGE, BGT, BLE,
+    BEQZ, BNEZ,
+    J, CALL, TAIL, RET
+};
+
+// 指令的书写格式，决定操作数的排布和打印方式
+enum class MFormat {
+    R,        // rd, rs1, rs2
+    I,        // rd, rs1, imm
+    Unary,    // rd, rs
+    LoadImm,  // rd, imm
+    LoadAddr, // rd, symbol
+    Load,     // rd, imm(rs)      操作数：rd, 基址, 偏移
+    Store,    // rs2, imm(rs1)    操作数：rs2, 基址, 偏移
+    LoadSym,  // rd, symbol       按符号访问全局变量，汇编器展开成 auipc + lw，链接时可以松弛成 gp 相对寻址
+    StoreSym, // rs2, symbol, rt  rt 是展开时借用的临时寄存器
+    Branch,   // rs1, rs2, label
+    BranchZ,  // rs, label
+    Jump,     // label
+    Call,     // symbol, 寄存器传的参数个数（不打印）
+    Ret
+};
+
+struct MOpcodeInfo {
+    const char* name;
+    MFormat format;
+};
+
+inline const MOpcodeInfo& opcodeInfo(MOpcode op) {
+    static const MOpcodeInfo table[] = {
+        {"li", MFormat::LoadImm}, {"la", MFormat::LoadAddr}, {"mv", MFormat::Unary},
+        {"lw", MFormat::Load}, {"sw", MFormat::Store},
+        {"lw", MFormat::LoadSym}, {"sw", MFormat::StoreSym},
+        {"add", MFormat::R}, {"sub", MFormat::R}, {"mul", MFormat::R}, {"div", MFormat::R},
+        {"rem", MFormat::R}, {"slt", MFormat::R}, {"sgt", MFormat::R}, {"xor", MFormat::R},
+        {"and", MFormat::R}, {"or", MFormat::R}, {"sll", MFormat::R}, {"srl", MFormat::R},
+        {"sra", MFormat::R}, {"mulh", MFormat::R},
+        {"addi", MFormat::I}, {"slti", MFormat::I}, {"xori", MFormat::I}, {"andi", MFormat::I},
+        {"ori", MFormat::I}, {"slli", MFormat::I}, {"srli", MFormat::I}, {"srai", MFormat::I},
+        {"seqz", MFormat::Unary}, {"snez", MFormat::Unary}, {"neg", MFormat::Unary},
+        {"beq", MFormat::Branch}, {"bne", MFormat::Branch}, {"blt", MFormat::Branch},
+        {"bge", MFormat::Branch}, {"bgt", MFormat::Branch}, {"ble", MFormat::Branch},
+        {"beqz", MFormat::BranchZ}, {"bnez", MFormat::BranchZ},
+        {"j", MFormat::Jump}, {"call", MFormat::Call}, {"tail", MFormat::Call}, {"ret", MFormat::Ret}
+    };
+    return table[(int)op];
+}
+
+class MachineBasicBlock;
+
+struct MOperand {
+    enum class Kind { Reg, Imm, FrameIndex, Block, Symbol };
+    Kind kind;
+    int value = 0;                      // 寄存器编号 / 立即数 / frame index
+    MachineBasicBlock* block = nullptr;
+    std::string symbol;
+
+    static MOperand reg(int r) { return {Kind::Reg, r}; }
+    static MOperand imm(int v) { return {Kind::Imm, v}; }
+    static MOperand frame(int fi) { return {Kind::FrameIndex, fi}; }
+    static MOperand label(MachineBasicBlock* b) { return {Kind::Block, 0, b}; }
+    static MOperand sym(const std::string& s) { return {Kind::Symbol, 0, nullptr, s}; }
+
+    bool isReg() const { return kind == Kind::Reg; }
+    bool isImm() const { return kind == Kind::Imm; }
+    bool isFrameIndex() const { return kind == Kind::FrameIndex; }
+};
+
+class MachineInstr {
+public:
+    MOpcode op;
+    std::vector<MOperand> ops;
+
+    MachineInstr(MOpcode o, std::vector<MOperand> operands) : op(o), ops(std::move(operands)) {}
+    MFormat format() const { return opcodeInfo(op).format; }
+};
+
+class MachineBasicBlock {
+public:
+    std::string label;
+    std::list<MachineInstr> insts;
+
+    explicit MachineBasicBlock(const std::string& l) : label(l) {}
+    void add(MOpcode op, std::vector<MOperand> operands) {
+        insts.emplace_back(op, std::move(operands));
+    }
+};
+
+// 栈上的一个对象；offset 在布局之后才确定，相对于 sp
+struct FrameObject {
+    int size;
+    int offset = 0;
+    bool incoming = false;  // 调用者栈帧里的第 8 个以后的参数
+    int incomingIndex = 0;
+    double weight = 0;      // 按循环深度加权的访问次数，布局时热的放低地址
+};
+
+class MachineFunction {
+public:
+    std::string name;
+    std::list<std::unique_ptr<MachineBasicBlock>> blocks;
+    std::vector<FrameObject> frameObjects;
+    bool hasCall = false;
+    int maxCallArgs = 0;
+    int raSlot = -1;        // 保存 ra 的栈对象，放在 R 区域
+    std::vector<std::pair<int, int>> calleeSavedSlots;  // 要保存的 s 寄存器和它的栈对象，也在 R 区域
+
+    explicit MachineFunction(const std::string& n) : name(n) {}
+
+    MachineBasicBlock* createBlock(const std::string& label) {
+        blocks.push_back(std::make_unique<MachineBasicBlock>(label));
+        return blocks.back().get();
+    }
+    int createFrameObject(int size) {
+        frameObjects.push_back({size});
+        return (int)frameObjects.size() - 1;
+    }
+    int createIncomingArg(int index) {
+        FrameObject obj{4};
+        obj.incoming = true;
+        obj.incomingIndex = index;
+        frameObjects.push_back(obj);
+        return (int)frameObjects.size() - 1;
+    }
+};
+
+// 寄存器集合，第 r 位表示 xr；x0 永远不算
+using RegMask = uint32_t;
+
+inline RegMask regBit(int r) { return r > 0 ? (RegMask)1 << r : 0; }
+
+inline RegMask callerSavedMask() {
+    RegMask m = regBit(RA);
+    for (int r : {T0, T1, T2, T3, T4, T5, T6}) m |= regBit(r);
+    for (int r = A0; r <= A7; ++r) m |= regBit(r);
+    return m;
+}
+
+inline RegMask calleeSavedMask() {
+    RegMask m = regBit(SP) | regBit(S0) | regBit(S1);
+    for (int r = S2; r <= S11; ++r) m |= regBit(r);
+    return m;
+}
+
+inline RegMask argRegsMask(int count = 8) {
+    RegMask m = 0;
+    for (int r = A0; r < A0 + count && r <= A7; ++r) m |= regBit(r);
+    return m;
+}
+
+// 指令写了哪些寄存器
+inline RegMask defMask(const MachineInstr& mi) {
+    switch (mi.format()) {
+        case MFormat::R:
+        case MFormat::I:
+        case MFormat::Unary:
+        case MFormat::LoadImm:
+        case MFormat::LoadAddr:
+        case MFormat::Load:
+        case MFormat::LoadSym:
+            return mi.ops[0].isReg() ? regBit(mi.ops[0].value) : 0;
+        case MFormat::StoreSym:
+            return regBit(mi.ops[2].value);
+        case MFormat::Call:
+            return callerSavedMask();
+        default:
+            return 0;
+    }
+}
+
+// 指令读了哪些寄存器；call 读的是传参用的 a 寄存器，没记参数个数时保守地认为读了全部
+inline RegMask useMask(const MachineInstr& mi) {
+    RegMask m = 0;
+    auto use = [&](size_t i) {
+        if (i < mi.ops.size() && mi.ops[i].isReg()) m |= regBit(mi.ops[i].value);
+    };
+    switch (mi.format()) {
+        case MFormat::R:
+            use(1); use(2);
+            break;
+        case MFormat::Branch:
+            use(0); use(1);
+            break;
+        case MFormat::I:
+        case MFormat::Unary:
+        case MFormat::Load:
+            use(1);
+            break;
+        case MFormat::Store:
+            use(0); use(1);
+            break;
+        case MFormat::BranchZ:
+        case MFormat::StoreSym:
+            use(0);
+            break;
+        case MFormat::Call:
+            m = argRegsMask(mi.ops.size() > 1 ? mi.ops[1].value : 8) | regBit(SP);
+            if (mi.op == MOpcode::TAIL) m |= calleeSavedMask() | regBit(RA);
+            break;
+        case MFormat::Ret:
+            m = regBit(A0) | regBit(RA) | calleeSavedMask();
+            break;
+        default:
+            break;
+    }
+    return m;
+}
+
+// 不算 ret/tail 对 callee-saved 寄存器的隐式使用：序言和尾声还没放的时候，
+// s 寄存器只在真正读写它的指令之间活跃
+inline RegMask explicitUseMask(const MachineInstr& mi) {
+    if (mi.op == MOpcode::RET) return regBit(A0) | regBit(RA);
+    if (mi.op == MOpcode::TAIL) return argRegsMask(mi.ops[1].value) | regBit(RA);
+    return useMask(mi);
+}
+
+// 没有副作用、只写一个寄存器的指令，结果没人用就能删
+inline bool isPureDef(const MachineInstr& mi) {
+    switch (mi.format()) {
+        case MFormat::R:
+        case MFormat::I:
+        case MFormat::Unary:
+        case MFormat::LoadImm:
+        case MFormat::LoadAddr:
+        case MFormat::Load:
+        case MFormat::LoadSym:
+            return mi.ops[0].isReg();
+        default:
+            return false;
+    }
+}
+
+// 第 i 个操作数是不是被写的寄存器
+inline bool isDefOperand(const MachineInstr& mi, size_t i) {
+    switch (mi.format()) {
+        case MFormat::R:
+        case MFormat::I:
+        case MFormat::Unary:
+        case MFormat::LoadImm:
+        case MFormat::LoadAddr:
+        case MFormat::Load:
+        case MFormat::LoadSym:
+            return i == 0;
+        case MFormat::StoreSym:
+            return i == 2;
+        default:
+            return false;
+    }
+}
+
+// 按 blocks 的顺序给块编号，并求出每个块的后继（包括落空到下一块）
+class MachineCFG {
+public:
+    std::vector<MachineBasicBlock*> blocks;
+    std::unordered_map<const MachineBasicBlock*, int> index;
+    std::vector<std::vector<int>> succs, preds;
+
+    explicit MachineCFG(const MachineFunction& mf) {
+        for (const auto& block : mf.blocks) {
+            index[block.get()] = (int)blocks.size();
+            blocks.push_back(block.get());
+        }
+        int n = (int)blocks.size();
+        succs.assign(n, {});
+        preds.assign(n, {});
+        for (int b = 0; b < n; ++b) {
+            bool fallsThrough = true;
+            for (const auto& mi : blocks[b]->insts) {
+                MFormat f = mi.format();
+                if (f == MFormat::Branch || f == MFormat::BranchZ || f == MFormat::Jump) {
+                    addEdge(b, index.at(mi.ops.back().block));
+                }
+            }
+            if (!blocks[b]->insts.empty()) {
+                MOpcode last = blocks[b]->insts.back().op;
+                fallsThrough = last != MOpcode::J && last != MOpcode::RET && last != MOpcode::TAIL;
+            }
+            if (fallsThrough && b + 1 < n) {
+                addEdge(b, b + 1);
+            }
+        }
+    }
+
+private:
+    void addEdge(int from, int to) {
+        for (int s : succs[from]) {
+            if (s == to) return;
+        }
+        succs[from].push_back(to);
+        preds[to].push_back(from);
+    }
+};
+
+// 寄存器的活跃分析；uses 决定每条指令读哪些寄存器，默认含 call/ret 的隐式使用
+class RegLiveness {
+public:
+    std::vector<RegMask> liveIn, liveOut;
+
+    explicit RegLiveness(const MachineCFG& cfg, RegMask (*uses)(const MachineInstr&) = useMask) {
+        int n = (int)cfg.blocks.size();
+        std::vector<RegMask> use(n, 0), def(n, 0);
+        liveIn.assign(n, 0);
+        liveOut.assign(n, 0);
+        for (int b = 0; b < n; ++b) {
+            for (const auto& mi : cfg.blocks[b]->insts) {
+                use[b] |= uses(mi) & ~def[b];
+                def[b] |= defMask(mi);
+            }
+        }
+        bool iterate = true;
+        while (iterate) {
+            iterate = false;
+            for (int b = n - 1; b >= 0; --b) {
+                RegMask out = 0;
+                for (int s : cfg.succs[b]) out |= liveIn[s];
+                liveOut[b] = out;
+                RegMask in = use[b] | (out & ~def[b]);
+                if (in != liveIn[b]) {
+                    liveIn[b] = in;
+                    iterate = true;
+                }
+            }
+        }
+    }
+};
+
+// 支配树（Cooper-Harvey-Kennedy 的迭代算法），块编号和 MachineCFG 一致
+class MachineDominators {
+public:
+    std::vector<int> idom;       // 入口的 idom 是自己，不可达的块是 -1
+    std::vector<int> rpoNumber;
+
+    explicit MachineDominators(const MachineCFG& cfg) {
+        int n = (int)cfg.blocks.size();
+        idom.assign(n, -1);
+        rpoNumber.assign(n, -1);
+        if (n == 0) return;
+        std::vector<int> order;
+        std::vector<char> visited(n, 0);
+        std::vector<std::pair<int, size_t>> stack{{0, 0}};
+        visited[0] = 1;
+        while (!stack.empty()) {
+            auto& top = stack.back();
+            if (top.second == cfg.succs[top.first].size()) {
+                order.push_back(top.first);
+                stack.pop_back();
+                continue;
+            }
+            int s = cfg.succs[top.first][top.second++];
+            if (!visited[s]) {
+                visited[s] = 1;
+                stack.push_back({s, 0});
+            }
+        }
+        std::reverse(order.begin(), order.end());
+        for (int i = 0; i < (int)order.size(); ++i) rpoNumber[order[i]] = i;
+
+        idom[0] = 0;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int b : order) {
+                if (b == 0) continue;
+                int newIdom = -1;
+                for (int p : cfg.preds[b]) {
+                    if (idom[p] < 0) continue;
+                    newIdom = newIdom < 0 ? p : commonDominator(p, newIdom);
+                }
+                if (newIdom != idom[b]) {
+                    idom[b] = newIdom;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    bool reachable(int b) const { return idom[b] >= 0; }
+
+    int commonDominator(int a, int b) const {
+        while (a != b) {
+            while (rpoNumber[a] > rpoNumber[b]) a = idom[a];
+            while (rpoNumber[b] > rpoNumber[a]) b = idom[b];
+        }
+        return a;
+    }
+
+    bool dominates(int a, int b) const {
+        if (!reachable(b)) return false;
+        while (b != a && b != 0) b = idom[b];
+        return b == a;
+    }
+};
+
+// 把 MachineFunction 打印成汇编文本，frame index 必须已经消除
+inline void printMachineFunction(const MachineFunction& mf, std::string& out) {
+    for (const auto& block : mf.blocks) {
+        out += block->label;
+        out += ":\n";
+        for (const auto& mi : block->insts) {
+            const MOpcodeInfo& info = opcodeInfo(mi.op);
+            out += "  ";
+            out += info.name;
+            const auto& o = mi.ops;
+            auto reg = [&](int i) { out += regName(o[i].value); };
+            switch (info.format) {
+                case MFormat::R:
+                    out += ' '; reg(0); out += ", "; reg(1); out += ", "; reg(2);
+                    break;
+                case MFormat::I:
+                    out += ' '; reg(0); out += ", "; reg(1); out += ", "; out += std::to_string(o[2].value);
+                    break;
+                case MFormat::Unary:
+                    out += ' '; reg(0); out += ", "; reg(1);
+                    break;
+                case MFormat::LoadImm:
+                    out += ' '; reg(0); out += ", "; out += std::to_string(o[1].value);
+                    break;
+                case MFormat::LoadAddr:
+                    out += ' '; reg(0); out += ", "; out += o[1].symbol;
+                    break;
+                case MFormat::Load:
+                case MFormat::Store:
+                    out += ' '; reg(0); out += ", "; out += std::to_string(o[2].value);
+                    out += '('; reg(1); out += ')';
+                    break;
+                case MFormat::LoadSym:
+                    out += ' '; reg(0); out += ", "; out += o[1].symbol;
+                    break;
+                case MFormat::StoreSym:
+                    out += ' '; reg(0); out += ", "; out += o[1].symbol; out += ", "; reg(2);
+                    break;
+                case MFormat::Branch:
+                    out += ' '; reg(0); out += ", "; reg(1); out += ", "; out += o[2].block->label;
+                    break;
+                case MFormat::BranchZ:
+                    out += ' '; reg(0); out += ", "; out += o[1].block->label;
+                    break;
+                case MFormat::Jump:
+                    out += ' '; out += o[0].block->label;
+                    break;
+                case MFormat::Call:
+                    out += ' '; out += o[0].symbol;
+                    break;
+                case MFormat::Ret:
+                    break;
+            }
+            out += '\n';
+        }
+    }
+}
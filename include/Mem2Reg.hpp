@@ -0,0 +1,338 @@
+#pragma once
+#include "ir.hpp"
+#include "Dominance.hpp"
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// mem2reg：只被 load/store 直接读写的标量 alloc 提升成 SSA 值，合流处用块参数代替 phi
+//   1. 删掉入口走不到的块，拆开所有关键边（两个后继的块 -> 多个前驱的块），
+//      这样带实参的总是 jump，复制可以放在跳转前面
+//   2. 在 store 所在块的迭代支配边界上放块参数，只放在变量活跃的块上（pruned SSA）
+//   3. 沿支配树先序重命名：load 换成当前值，store 更新当前值，jump 带上目标块参数的当前值
+//   4. 所有实参都相同的块参数换成那个值，没人用的块参数删掉；最后没带实参的拆边块合回去
+class Mem2Reg {
+public:
+    bool run(Program& prog) {
+        bool changed = false;
+        for (auto& func : prog.funcs) {
+            changed |= run(*func);
+        }
+        return changed;
+    }
+
+    bool run(Function& func) {
+        if (func.blocks.empty()) return false;
+        removeUnreachableBlocks(func);
+        std::vector<AllocInst*> allocs = findPromotable(func);
+        if (allocs.empty()) return false;
+        if (!func.blocks.front()->preds.empty()) return false;  // 入口不能带参数
+        splitCriticalEdges(func);
+
+        DominatorTree dom(func);
+        placeArgs(func, dom, allocs);
+        rename(func, dom, allocs);
+        simplifyArgs(func);
+        mergeSplitBlocks(func);
+        return true;
+    }
+
+private:
+    std::unordered_map<const AllocInst*, int> allocIndex;
+    std::unordered_map<const BlockArg*, int> argAlloc;  // 块参数代表第几个 alloc
+    std::vector<std::pair<BasicBlock*, BasicBlock*>> splitEdges;  // 拆边块和它唯一的前驱
+
+    // 地址只出现在 load 的地址、store 的地址位置上的标量 alloc
+    std::vector<AllocInst*> findPromotable(Function& func) {
+        std::vector<AllocInst*> allocs;
+        std::unordered_set<const Value*> escaped;
+        for (auto& block : func.blocks) {
+            for (auto& inst : block->insts) {
+                if (inst->op == OpType::Alloc) {
+                    auto alloc = static_cast<AllocInst*>(inst.get());
+                    if (!alloc->isArray) allocs.push_back(alloc);
+                    continue;
+                }
+                if (inst->op == OpType::Load) continue;
+                auto ops = inst->operands();
+                for (size_t i = 0; i < ops.size(); ++i) {
+                    if (inst->op == OpType::Store && i == 1) continue;
+                    escaped.insert(ops[i]);
+                }
+            }
+        }
+        allocs.erase(std::remove_if(allocs.begin(), allocs.end(),
+            [&](AllocInst* a) { return escaped.count(a) > 0; }), allocs.end());
+        allocIndex.clear();
+        for (size_t i = 0; i < allocs.size(); ++i) allocIndex[allocs[i]] = (int)i;
+        return allocs;
+    }
+
+    void splitCriticalEdges(Function& func) {
+        splitEdges.clear();
+        func.updateCFG();
+        int counter = 0;
+        for (auto it = func.blocks.begin(); it != func.blocks.end(); ++it) {
+            BasicBlock* block = it->get();
+            if (block->insts.empty() || block->insts.back()->op != OpType::Br) continue;
+            auto br = static_cast<BranchInst*>(block->insts.back().get());
+            for (BasicBlock** target : {&br->thenBlock, &br->elseBlock}) {
+                if ((*target)->preds.size() < 2) continue;
+                auto edge = new BasicBlock(block->name + "_split_" + std::to_string(counter++));
+                edge->addInst(new JumpInst(*target));
+                splitEdges.push_back({edge, block});
+                *target = edge;
+                it = func.blocks.insert(std::next(it), std::unique_ptr<BasicBlock>(edge));
+            }
+        }
+        func.invalidateCFG();
+    }
+
+    // 每个 alloc 在哪些块上需要块参数
+    void placeArgs(Function& func, const DominatorTree& dom, const std::vector<AllocInst*>& allocs) {
+        int n = dom.size();
+        size_t m = allocs.size();
+        std::vector<std::vector<int>> defBlocks(m), exposedBlocks(m);
+        std::vector<std::vector<char>> stores(m);
+        for (int b = 0; b < n; ++b) {
+            std::vector<char> stored(m, 0);
+            for (const auto& inst : dom.blocks[b]->insts) {
+                if (inst->op == OpType::Store) {
+                    auto it = allocIndex.find(static_cast<const AllocInst*>(static_cast<StoreInst*>(inst.get())->address));
+                    if (it == allocIndex.end() || stored[it->second]) continue;
+                    stored[it->second] = 1;
+                    defBlocks[it->second].push_back(b);
+                } else if (inst->op == OpType::Load) {
+                    auto it = allocIndex.find(static_cast<const AllocInst*>(static_cast<LoadInst*>(inst.get())->address));
+                    if (it == allocIndex.end() || stored[it->second]) continue;
+                    if (exposedBlocks[it->second].empty() || exposedBlocks[it->second].back() != b) {
+                        exposedBlocks[it->second].push_back(b);
+                    }
+                }
+            }
+        }
+
+        argAlloc.clear();
+        std::vector<int> liveStamp(n, -1), storeStamp(n, -1), argStamp(n, -1), queuedStamp(n, -1);
+        std::vector<int> work;
+        for (size_t a = 0; a < m; ++a) {
+            int stamp = (int)a;
+            for (int b : defBlocks[a]) storeStamp[b] = stamp;
+            // 变量在块入口活跃：块里有先于 store 的 load，或者块里没有 store 且出口活跃
+            for (int b : exposedBlocks[a]) {
+                liveStamp[b] = stamp;
+                work.push_back(b);
+            }
+            while (!work.empty()) {
+                int b = work.back();
+                work.pop_back();
+                for (int p : dom.preds[b]) {
+                    if (liveStamp[p] == stamp || storeStamp[p] == stamp) continue;
+                    liveStamp[p] = stamp;
+                    work.push_back(p);
+                }
+            }
+            // 迭代支配边界
+            for (int b : defBlocks[a]) {
+                queuedStamp[b] = stamp;
+                work.push_back(b);
+            }
+            std::string base = allocs[a]->name.substr(1);
+            int counter = 0;
+            while (!work.empty()) {
+                int b = work.back();
+                work.pop_back();
+                for (int f : dom.frontier[b]) {
+                    if (argStamp[f] == stamp || liveStamp[f] != stamp) continue;
+                    argStamp[f] = stamp;
+                    BlockArg* arg = dom.blocks[f]->addArg("%" + base + "_" + std::to_string(counter++), Type::Int32);
+                    argAlloc[arg] = stamp;
+                    if (queuedStamp[f] != stamp) {
+                        queuedStamp[f] = stamp;
+                        work.push_back(f);
+                    }
+                }
+            }
+        }
+    }
+
+    void rename(Function& func, const DominatorTree& dom, const std::vector<AllocInst*>& allocs) {
+        // 没被 store 过就读的变量，值是未定义的，取 0
+        auto undef = new Integer(0);
+        func.blocks.front()->addValue(undef);
+
+        std::vector<std::vector<Value*>> current(allocs.size());
+        std::unordered_map<const Value*, Value*> replaced;
+        auto top = [&](int a) { return current[a].empty() ? static_cast<Value*>(undef) : current[a].back(); };
+        auto promotedIndex = [&](const Value* address) {
+            auto it = allocIndex.find(static_cast<const AllocInst*>(address));
+            return it == allocIndex.end() ? -1 : it->second;
+        };
+
+        // 支配树先序遍历，离开一个块时弹出它压进的值
+        std::vector<std::pair<int, size_t>> stack{{0, 0}};
+        std::vector<std::vector<int>> pushed(dom.size());
+        auto enter = [&](int b) {
+            BasicBlock* block = dom.blocks[b];
+            for (BlockArg* arg : block->args) {
+                int a = argAlloc.at(arg);
+                current[a].push_back(arg);
+                pushed[b].push_back(a);
+            }
+            for (auto it = block->insts.begin(); it != block->insts.end();) {
+                Instruction* inst = it->get();
+                for (Value* op : inst->operands()) {
+                    auto r = replaced.find(op);
+                    if (r != replaced.end()) inst->replaceOperand(op, r->second);
+                }
+                if (inst->op == OpType::Load) {
+                    int a = promotedIndex(static_cast<LoadInst*>(inst)->address);
+                    if (a >= 0) {
+                        replaced[inst] = top(a);
+                        it = block->insts.erase(it);
+                        continue;
+                    }
+                } else if (inst->op == OpType::Store) {
+                    auto store = static_cast<StoreInst*>(inst);
+                    int a = promotedIndex(store->address);
+                    if (a >= 0) {
+                        current[a].push_back(store->value);
+                        pushed[b].push_back(a);
+                        it = block->insts.erase(it);
+                        continue;
+                    }
+                } else if (inst->op == OpType::Jump) {
+                    auto jump = static_cast<JumpInst*>(inst);
+                    for (BlockArg* arg : jump->targetBlock->args) jump->args.push_back(top(argAlloc.at(arg)));
+                }
+                ++it;
+            }
+        };
+        enter(0);
+        while (!stack.empty()) {
+            auto& frame = stack.back();
+            int b = frame.first;
+            if (frame.second == dom.children[b].size()) {
+                for (int a : pushed[b]) current[a].pop_back();
+                stack.pop_back();
+                continue;
+            }
+            int c = dom.children[b][frame.second++];
+            enter(c);
+            stack.push_back({c, 0});
+        }
+
+        for (AllocInst* alloc : allocs) {
+            for (auto& block : func.blocks) {
+                auto& insts = block->insts;
+                auto it = std::find_if(insts.begin(), insts.end(),
+                    [&](const std::unique_ptr<Instruction>& inst) { return inst.get() == alloc; });
+                if (it != insts.end()) {
+                    insts.erase(it);
+                    break;
+                }
+            }
+        }
+    }
+
+    // 拆出来但没有带实参的块：让前驱直接跳到目标
+    void mergeSplitBlocks(Function& func) {
+        func.updateCFG();
+        for (auto& split : splitEdges) {
+            BasicBlock* block = split.first;
+            auto jump = static_cast<JumpInst*>(block->insts.back().get());
+            if (!jump->args.empty()) continue;
+            func.replaceSuccessor(split.second, block, jump->targetBlock);
+            func.removeBlock(block);
+        }
+    }
+
+    // 块参数的化简，反复做到不动为止：
+    //   除了自己以外所有实参都是同一个值的块参数，换成那个值
+    //   只被当作实参传给没用的块参数（或者根本没人用）的块参数，删掉
+    void simplifyArgs(Function& func) {
+        for (bool changed = true; changed;) {
+            changed = false;
+            std::unordered_map<const BasicBlock*, std::vector<JumpInst*>> incoming;
+            for (auto& block : func.blocks) {
+                if (!block->insts.empty() && block->insts.back()->op == OpType::Jump) {
+                    auto jump = static_cast<JumpInst*>(block->insts.back().get());
+                    incoming[jump->targetBlock].push_back(jump);
+                }
+            }
+
+            std::unordered_map<const Value*, Value*> replaced;
+            for (auto& block : func.blocks) {
+                for (size_t i = 0; i < block->args.size(); ++i) {
+                    BlockArg* arg = block->args[i];
+                    Value* same = nullptr;
+                    bool trivial = true;
+                    for (JumpInst* jump : incoming[block.get()]) {
+                        Value* v = jump->args[i];
+                        if (v == arg || v == same) continue;
+                        if (same) { trivial = false; break; }
+                        same = v;
+                    }
+                    if (trivial && same) replaced[arg] = same;
+                }
+            }
+            if (!replaced.empty()) {
+                auto resolve = [&](Value* v) {
+                    for (auto r = replaced.find(v); r != replaced.end(); r = replaced.find(v)) v = r->second;
+                    return v;
+                };
+                for (auto& block : func.blocks) {
+                    for (auto& inst : block->insts) {
+                        for (Value* op : inst->operands()) {
+                            if (replaced.count(op)) inst->replaceOperand(op, resolve(op));
+                        }
+                    }
+                }
+                removeArgs(func, incoming, [&](const BlockArg* arg) { return replaced.count(arg) > 0; });
+                changed = true;
+                continue;
+            }
+
+            // 活跃的块参数：被普通指令用到，或者作为实参传给活跃的块参数
+            std::unordered_set<const Value*> live;
+            std::vector<const BlockArg*> work;
+            for (auto& block : func.blocks) {
+                for (auto& inst : block->insts) {
+                    if (inst->op == OpType::Jump) continue;
+                    for (Value* op : inst->operands()) {
+                        auto arg = dynamic_cast<const BlockArg*>(op);
+                        if (arg && live.insert(arg).second) work.push_back(arg);
+                    }
+                }
+            }
+            while (!work.empty()) {
+                const BlockArg* arg = work.back();
+                work.pop_back();
+                const auto& args = arg->parent->args;
+                size_t i = std::find(args.begin(), args.end(), arg) - args.begin();
+                for (JumpInst* jump : incoming[arg->parent]) {
+                    auto src = dynamic_cast<const BlockArg*>(jump->args[i]);
+                    if (src && live.insert(src).second) work.push_back(src);
+                }
+            }
+            changed = removeArgs(func, incoming, [&](const BlockArg* arg) { return live.count(arg) == 0; });
+        }
+    }
+
+    template <typename Pred>
+    bool removeArgs(Function& func, std::unordered_map<const BasicBlock*, std::vector<JumpInst*>>& incoming, Pred dead) {
+        bool removed = false;
+        for (auto& block : func.blocks) {
+            auto& args = block->args;
+            for (size_t i = args.size(); i-- > 0;) {
+                if (!dead(args[i])) continue;
+                for (JumpInst* jump : incoming[block.get()]) jump->args.erase(jump->args.begin() + i);
+                args.erase(args.begin() + i);
+                removed = true;
+            }
+        }
+        return removed;
+    }
+};
@@ -0,0 +1,303 @@
+#pragma once
+#include "MachineIR.hpp"
+#include "StackSlots.hpp"
+#include <map>
+#include <vector>
+
+// 机器级窥孔：在 frame index 消除之前跑，栈槽还能按 frame index 区分
+//   1. 刚存进栈槽又读出来的值直接用原寄存器
+//   2. 之后再也不会被读的栈槽，对它的 sw 删掉
+//   3. li 喂给算术指令的常数折叠成立即数形式；比较（含 slti/xori）+ bnez 融合成条件分支
+//   4. 结果没人用的纯计算删掉
+class PeepholeCombiner {
+public:
+    // 返回删掉的指令条数
+    int run(MachineFunction& mf) {
+        int before = countInsts(mf);
+        findTrackedSlots(mf);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            changed |= forwardStores(mf);
+            changed |= removeDeadStores(mf);
+            computeRegLiveness(mf);
+            changed |= combine(mf);
+            computeRegLiveness(mf);
+            changed |= removeDeadDefs(mf);
+        }
+        return before - countInsts(mf);
+    }
+
+private:
+    // 只跟踪 4 字节、地址没有被取过的栈槽，它们只会通过 lw/sw 直接访问
+    std::vector<int> slotId;   // frame index -> 跟踪编号，-1 表示不跟踪
+    int numSlots = 0;
+    std::vector<RegMask> regLiveOut;
+
+    static int countInsts(const MachineFunction& mf) {
+        int n = 0;
+        for (const auto& block : mf.blocks) n += (int)block->insts.size();
+        return n;
+    }
+
+    void findTrackedSlots(const MachineFunction& mf) {
+        slotId = trackedFrameSlots(mf, numSlots);
+    }
+
+    int trackedSlot(const MachineInstr& mi) const {
+        return accessedSlot(mi, slotId);
+    }
+
+    // 块内前向：记住每个栈槽当前的值还在哪个寄存器里
+    bool forwardStores(MachineFunction& mf) {
+        bool changed = false;
+        for (auto& block : mf.blocks) {
+            std::map<int, int> avail; // 栈槽 -> 寄存器
+            auto kill = [&](RegMask defs) {
+                for (auto it = avail.begin(); it != avail.end();) {
+                    if (defs & regBit(it->second)) it = avail.erase(it);
+                    else ++it;
+                }
+            };
+            auto& insts = block->insts;
+            for (auto it = insts.begin(); it != insts.end();) {
+                int slot = trackedSlot(*it);
+                if (slot >= 0 && it->op == MOpcode::SW) {
+                    avail[slot] = it->ops[0].value;
+                } else if (slot >= 0) {
+                    int rd = it->ops[0].value;
+                    auto known = avail.find(slot);
+                    if (known != avail.end()) {
+                        changed = true;
+                        if (known->second == rd) {
+                            it = insts.erase(it);
+                            continue;
+                        }
+                        *it = MachineInstr(MOpcode::MV, {MOperand::reg(rd), MOperand::reg(known->second)});
+                        kill(regBit(rd));
+                    } else {
+                        kill(regBit(rd));
+                        avail[slot] = rd;
+                    }
+                } else {
+                    kill(defMask(*it));
+                }
+                ++it;
+            }
+        }
+        return changed;
+    }
+
+    // 不活跃处的 sw 是死存储
+    bool removeDeadStores(MachineFunction& mf) {
+        if (numSlots == 0) return false;
+        SlotLiveness slots(mf);
+        bool changed = false;
+        for (int b = 0; b < (int)slots.cfg.blocks.size(); ++b) {
+            BitSet live = slots.liveOut(b);
+            auto& insts = slots.cfg.blocks[b]->insts;
+            for (auto it = insts.end(); it != insts.begin();) {
+                --it;
+                int slot = slots.slotOf(*it);
+                if (slot < 0) continue;
+                if (it->op == MOpcode::LW) {
+                    live.set(slot);
+                } else if (!live.test(slot)) {
+                    it = insts.erase(it);
+                    changed = true;
+                } else {
+                    live.reset(slot);
+                }
+            }
+        }
+        return changed;
+    }
+
+    void computeRegLiveness(const MachineFunction& mf) {
+        regLiveOut = RegLiveness(MachineCFG(mf)).liveOut;
+    }
+
+    // 每条指令之后活跃的寄存器
+    static std::vector<RegMask> liveAfter(const MachineBasicBlock& block, RegMask liveOut) {
+        std::vector<RegMask> after(block.insts.size());
+        RegMask live = liveOut;
+        int i = (int)block.insts.size();
+        for (auto it = block.insts.rbegin(); it != block.insts.rend(); ++it) {
+            after[--i] = live;
+            live = (live & ~defMask(*it)) | useMask(*it);
+        }
+        return after;
+    }
+
+    static bool fitsImm12(int x) { return x >= -2048 && x <= 2047; }
+
+    // op rd, rs, C 的立即数形式；没有就返回 false
+    static bool immediateForm(MOpcode op, int c, bool constOnLeft, MOpcode& immOp, int& imm) {
+        imm = c;
+        switch (op) {
+            case MOpcode::ADD: immOp = MOpcode::ADDI; return fitsImm12(c);
+            case MOpcode::AND: immOp = MOpcode::ANDI; return fitsImm12(c);
+            case MOpcode::OR:  immOp = MOpcode::ORI;  return fitsImm12(c);
+            case MOpcode::XOR: immOp = MOpcode::XORI; return fitsImm12(c);
+            case MOpcode::SUB:
+                imm = -c;
+                immOp = MOpcode::ADDI;
+                return !constOnLeft && fitsImm12(-c);
+            case MOpcode::SLT:
+                immOp = MOpcode::SLTI;
+                return !constOnLeft && fitsImm12(c);
+            case MOpcode::SGT:  // C > rs  等价于  rs < C
+                immOp = MOpcode::SLTI;
+                return constOnLeft && fitsImm12(c);
+            case MOpcode::SLL: immOp = MOpcode::SLLI; return !constOnLeft && c >= 0 && c < 32;
+            case MOpcode::SRL: immOp = MOpcode::SRLI; return !constOnLeft && c >= 0 && c < 32;
+            case MOpcode::SRA: immOp = MOpcode::SRAI; return !constOnLeft && c >= 0 && c < 32;
+            default: return false;
+        }
+    }
+
+    bool combine(MachineFunction& mf) {
+        bool changed = false;
+        int b = 0;
+        for (auto& blockPtr : mf.blocks) {
+            auto& insts = blockPtr->insts;
+            std::vector<RegMask> after = liveAfter(*blockPtr, regLiveOut[b++]);
+            // 改写只会删掉寄存器的使用，旧的活跃信息仍然是保守的
+            std::vector<std::list<MachineInstr>::iterator> pos;
+            for (auto it = insts.begin(); it != insts.end(); ++it) pos.push_back(it);
+            std::vector<char> erased(pos.size(), 0);
+
+            for (size_t i = 0; i < pos.size(); ++i) {
+                if (erased[i]) continue;
+                MachineInstr& mi = *pos[i];
+                if (mi.op == MOpcode::LI) {
+                    changed |= foldLoadImm(pos, erased, after, i);
+                } else if (mi.op == MOpcode::BNEZ) {
+                    changed |= fuseBranch(pos, erased, after, i);
+                }
+            }
+            for (size_t i = 0; i < pos.size(); ++i) {
+                if (erased[i]) insts.erase(pos[i]);
+            }
+        }
+        return changed;
+    }
+
+    // li t, C 之后第一条碰到 t 的指令如果能吃立即数，并且 t 之后不再活跃，就折进去
+    bool foldLoadImm(std::vector<std::list<MachineInstr>::iterator>& pos, std::vector<char>& erased,
+                     const std::vector<RegMask>& after, size_t i) {
+        int t = pos[i]->ops[0].value;
+        int c = pos[i]->ops[1].value;
+        for (size_t j = i + 1; j < pos.size(); ++j) {
+            if (erased[j]) continue;
+            MachineInstr& user = *pos[j];
+            if (!((useMask(user) | defMask(user)) & regBit(t))) continue;
+            if (user.format() != MFormat::R || (after[j] & regBit(t) && user.ops[0].value != t)) {
+                return false;
+            }
+            int lhs = user.ops[1].value, rhs = user.ops[2].value;
+            // 恰好一个源操作数是 t 才能折；都不是说明这条只是覆盖 t，li 本身是死的，留给 removeDeadDefs
+            if ((lhs == t) == (rhs == t)) return false;
+            bool constOnLeft = lhs == t;
+            MOpcode immOp;
+            int imm;
+            bool commutative = user.op == MOpcode::ADD || user.op == MOpcode::AND ||
+                               user.op == MOpcode::OR || user.op == MOpcode::XOR;
+            if (!immediateForm(user.op, c, constOnLeft && !commutative, immOp, imm)) {
+                return false;
+            }
+            int rs = constOnLeft ? rhs : lhs;
+            user = MachineInstr(immOp, {user.ops[0], MOperand::reg(rs), MOperand::imm(imm)});
+            erased[i] = 1;
+            return true;
+        }
+        return false;
+    }
+
+    // xor/slt/sgt (+ seqz/snez) + bnez，中间结果只给分支用时融合成一条分支
+    bool fuseBranch(std::vector<std::list<MachineInstr>::iterator>& pos, std::vector<char>& erased,
+                    const std::vector<RegMask>& after, size_t i) {
+        MachineInstr& br = *pos[i];
+        int cond = br.ops[0].value;
+        if (cond == ZERO || (after[i] & regBit(cond))) return false;
+        auto prev = [&](size_t k) -> long {
+            for (long j = (long)k - 1; j >= 0; --j) {
+                if (!erased[j]) return j;
+            }
+            return -1;
+        };
+        long p = prev(i);
+        if (p < 0) return false;
+        bool negate = false;
+        long cmpIdx = p;
+        MachineInstr* test = &*pos[p];
+        if ((test->op == MOpcode::SEQZ || test->op == MOpcode::SNEZ) &&
+            test->ops[0].value == cond && test->ops[1].value == cond) {
+            negate = test->op == MOpcode::SEQZ;
+            cmpIdx = prev(p);
+            if (cmpIdx < 0) return false;
+        } else {
+            test = nullptr;
+        }
+        MachineInstr& cmp = *pos[cmpIdx];
+        bool immCmp = cmp.op == MOpcode::SLTI || cmp.op == MOpcode::XORI;
+        if ((cmp.format() != MFormat::R && !immCmp) || cmp.ops[0].value != cond) return false;
+        int a = cmp.ops[1].value, b = immCmp ? ZERO : cmp.ops[2].value;
+        MOpcode fused;
+        if (cmp.op == MOpcode::XOR || cmp.op == MOpcode::XORI) {
+            fused = negate ? MOpcode::BEQ : MOpcode::BNE;
+        } else if (cmp.op == MOpcode::SLT || cmp.op == MOpcode::SLTI) {
+            fused = negate ? MOpcode::BGE : MOpcode::BLT;
+        } else if (cmp.op == MOpcode::SGT) {
+            fused = negate ? MOpcode::BLE : MOpcode::BGT;
+        } else {
+            return false;
+        }
+        // 立即数比较：常数非零时要先 li 到一个空闲寄存器里，比较结果的寄存器或者 t1
+        bool needLoadImm = immCmp && cmp.ops[2].value != 0;
+        if (needLoadImm) {
+            if (cond != a) {
+                b = cond;
+            } else if (a != T1 && !(after[i] & regBit(T1))) {
+                b = T1;
+            } else {
+                return false;
+            }
+        }
+        MOperand target = br.ops[1];
+        if (b == ZERO && (fused == MOpcode::BEQ || fused == MOpcode::BNE)) {
+            br = MachineInstr(fused == MOpcode::BEQ ? MOpcode::BEQZ : MOpcode::BNEZ,
+                              {MOperand::reg(a), target});
+        } else {
+            br = MachineInstr(fused, {MOperand::reg(a), MOperand::reg(b), target});
+        }
+        if (needLoadImm) {
+            cmp = MachineInstr(MOpcode::LI, {MOperand::reg(b), MOperand::imm(cmp.ops[2].value)});
+        } else {
+            erased[cmpIdx] = 1;
+        }
+        if (test) erased[p] = 1;
+        return true;
+    }
+
+    // 逆序扫描，删掉结果不活跃的纯计算和自己到自己的 mv
+    bool removeDeadDefs(MachineFunction& mf) {
+        bool changed = false;
+        int b = 0;
+        for (auto& block : mf.blocks) {
+            RegMask live = regLiveOut[b++];
+            auto& insts = block->insts;
+            for (auto it = insts.end(); it != insts.begin();) {
+                --it;
+                bool selfMove = it->op == MOpcode::MV && it->ops[0].value == it->ops[1].value;
+                if (selfMove || (isPureDef(*it) && it->ops[0].value != SP && !(live & defMask(*it)))) {
+                    it = insts.erase(it);
+                    changed = true;
+                    continue;
+                }
+                live = (live & ~defMask(*it)) | useMask(*it);
+            }
+        }
+        return changed;
+    }
+};
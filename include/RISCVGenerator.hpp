@@ -1,6 +1,17 @@
 #pragma once
 #include "ir.hpp"
+#include "MachineIR.hpp"
+#include "AddressSinking.hpp"
+#include "BlockLayout.hpp"
+#include "GlobalAddrHoist.hpp"
+#include "Peephole.hpp"
+#include "ShrinkWrap.hpp"
+#include "StackSlots.hpp"
+#include "TailRecursion.hpp"
+#include "RegAlloc.hpp"
+#include <cstdint>
 #include <map>
+#include <set>
 #include <string>
 #include <sstream>
 #include <iostream>
@@ -10,99 +21,170 @@ struct StackLayout {
     int S,R,A,total;
     int raOffset;
     StackLayout() : S(0), R(0), A(0), total(0), raOffset(0) {}
-    StackLayout(int s, int r, int a, int t, int ra) 
+    StackLayout(int s, int r, int a, int t, int ra)
         : S(s), R(r), A(a), total(t), raOffset(ra) {}
 };
 
-StackLayout computeLayout(const Function& func,std::map<std::string, int>& stackMap){
+// 给 MachineFunction 的栈对象定下 sp 偏移
+// 窥孔之后已经没有指令访问的栈对象不占空间；叶函数的值都在寄存器里时整个栈帧为空，
+// 序言和尾声都不用生成
+StackLayout computeLayout(MachineFunction& mf){
     int S=0,R=0,A=0;
-    int maxArgs=0;
-    bool hasCall=false;
-
-    //计算 call 的数量来决定 R的大小
-    for(const auto& block : func.blocks) {
-        for (const auto& inst : block->insts) {
-            if (inst->op == OpType::Call) {
-                hasCall=true;
-                auto callInst = static_cast<CallInst*>(inst.get());
-                maxArgs = std::max(maxArgs, (int)callInst->args.size());
+    std::vector<char> referenced(mf.frameObjects.size(), 0);
+    for (const auto& block : mf.blocks) {
+        for (const auto& mi : block->insts) {
+            for (const auto& op : mi.ops) {
+                if (op.isFrameIndex()) referenced[op.value] = 1;
             }
         }
     }
     //计算 A 的大小
-    A = std::max(0, maxArgs - 8) * 4;
-    //计算 R 的大小
-    R = hasCall ? 4 : 0;
-    //计算 S 的大小         分两部分：参数和 alloc/int32类型的指令
+    A = std::max(0, mf.maxCallArgs - 8) * 4;
+    //计算 R 的大小         ra 和用到的 s 寄存器
+    R = (mf.hasCall ? 4 : 0) + 4 * (int)mf.calleeSavedSlots.size();
+    //计算 S 的大小         参数、alloc 和溢出的值；标量在前、数组在后，各自按访问频率从高到低往上排
+    std::vector<int> order;
+    for (int i = 0; i < (int)mf.frameObjects.size(); ++i) {
+        const auto& obj = mf.frameObjects[i];
+        if (obj.incoming || i == mf.raSlot || !referenced[i]) continue;
+        order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        const auto& x = mf.frameObjects[a];
+        const auto& y = mf.frameObjects[b];
+        if ((x.size > 4) != (y.size > 4)) return x.size <= 4;
+        return x.weight > y.weight;
+    });
     int offset=A;
-    for (const auto& param : func.params) {
-    stackMap[param.first] = offset; // 给参数名登记 offset
-    offset += 4;                   // 每个参数占 4 字节
-    }
-    for(const auto& block : func.blocks) {
-        for (const auto& inst : block->insts) {
-            if (inst->op == OpType::Alloc) {
-                auto alloc = static_cast<AllocInst*>(inst.get());
-                stackMap[inst->name] = offset;
-                offset += alloc->arraySize * 4; // 数组占 size * 4
-            } 
-            else {
-            switch (inst->type) {
-                case Type::Int32:
-                case Type::Pointer:
-                    stackMap[inst->name] = offset;
-                    offset += 4;
-                    break;
-                case Type::Void:
-                case Type::Label:
-                    break;
-            }
-        }
-        }
+    for (int i : order) {
+        mf.frameObjects[i].offset = offset;
+        offset += mf.frameObjects[i].size;
     }
     S=offset-A;
     //计算栈上总分配 total 的大小
     int total = (A + S + R + 15) / 16 * 16;
-    int raOffset = total - R; // ra 存在 R 区域的最后
+    int raOffset = total - 4; // ra 存在 R 区域的最后，s 寄存器从 R 区域的开头往上放
+    //调用者传进来的第 8 个以后的参数在 sp + total 之上
+    for (auto& obj : mf.frameObjects) {
+        if (obj.incoming) obj.offset = total + obj.incomingIndex * 4;
+    }
+    int saveOffset = total - R;
+    for (const auto& saved : mf.calleeSavedSlots) {
+        mf.frameObjects[saved.second].offset = saveOffset;
+        saveOffset += 4;
+    }
+    if (mf.raSlot >= 0) mf.frameObjects[mf.raSlot].offset = raOffset;
     return {S,R,A,total,raOffset};
 }
-StackLayout currentLayout;
+
+// 有符号除以常数 d 的魔数（Hacker's Delight 10-1），要求 |d| >= 2
+// q = mulh(x, M)，再按 d 和 M 的符号修正、右移 s 位
+struct DivMagic {
+    int M;
+    int s;
+};
+
+inline DivMagic computeDivMagic(int d) {
+    const uint32_t two31 = 0x80000000u;
+    uint32_t ad = d < 0 ? 0u - (uint32_t)d : (uint32_t)d;
+    uint32_t t = two31 + ((uint32_t)d >> 31);
+    uint32_t anc = t - 1 - t % ad;
+    int p = 31;
+    uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+    uint32_t delta;
+    do {
+        p++;
+        q1 *= 2; r1 *= 2;
+        if (r1 >= anc) { q1++; r1 -= anc; }
+        q2 *= 2; r2 *= 2;
+        if (r2 >= ad) { q2++; r2 -= ad; }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    int M = (int)(q2 + 1);
+    if (d < 0) M = -M;
+    return {M, p - 32};
+}
+
+// x 是不是 2 的幂，是的话返回指数
+inline int log2Exact(uint32_t x) {
+    if (x == 0 || (x & (x - 1))) return -1;
+    return __builtin_ctz(x);
+}
 
 class RISCVGenerator {
 private:
     std::stringstream ss;
     std::string currentFuncLabel;
-    bool isFirstBlockInCurrentFunc = false;
+    std::unique_ptr<MachineFunction> mf;
+    MachineBasicBlock* curBlock = nullptr;
+    std::map<const BasicBlock*, MachineBasicBlock*> blockMap;
+    std::set<const Value*> fusedConditions;//只给紧随其后的 br 用的比较，不单独生成
+    std::set<const Value*> tailCalls;//拆掉栈帧后直接 tail 过去的调用，以及它们后面的 ret
+    std::set<const Value*> foldedAddrs;//折进 lw/sw 偏移的 getelemptr/getptr，不单独生成
 
-    bool fitsImm12(int x) const {
+    static bool fitsImm12(int x) {
         return x >= -2048 && x <= 2047;
     }
 
-    void emitSpAddr(const std::string& dst, int offset, const std::string& scratch = "t3") {
-        if (fitsImm12(offset)) {
-            ss << "  addi " << dst << ", sp, " << offset << "\n";
-        } else {
-            ss << "  li " << scratch << ", " << offset << "\n";
-            ss << "  add " << dst << ", sp, " << scratch << "\n";
+    // 初始值按段输出：稀疏表之间的空隙合成 .zero，偏移相连的重复值合成 .fill，其余每个值一行 .word
+    // 只按非 0 的元素走，不展开整个数组
+    void emitInitializer(const SparseInit& values, int size) {
+        const int minFillRun = 3;
+        int cursor = 0;
+        for (size_t k = 0; k < values.size();) {
+            int offset = values[k].first, value = values[k].second;
+            if (offset > cursor) ss << "  .zero " << (offset - cursor) * 4 << "\n";
+            size_t j = k + 1;
+            while (j < values.size() && values[j].first == values[j - 1].first + 1 && values[j].second == value) ++j;
+            int run = (int)(j - k);
+            if (run >= minFillRun) {
+                ss << "  .fill " << run << ", 4, " << value << "\n";
+            } else {
+                for (int r = 0; r < run; ++r) ss << "  .word " << value << "\n";
+            }
+            cursor = offset + run;
+            k = j;
         }
+        if (cursor < size) ss << "  .zero " << (size - cursor) * 4 << "\n";
     }
 
-    void emitLoadFromSp(const std::string& dst, int offset, const std::string& scratch = "t3") {
-        if (fitsImm12(offset)) {
-            ss << "  lw " << dst << ", " << offset << "(sp)\n";
-        } else {
-            emitSpAddr(scratch, offset, "t4");
-            ss << "  lw " << dst << ", 0(" << scratch << ")\n";
-        }
+    // 放进小数据段、按符号直接 lw/sw 的全局变量
+    static bool isSmallGlobal(const GlobalAlloc& global) {
+        return global.size == 1;
     }
 
-    void emitStoreToSp(const std::string& src, int offset, const std::string& scratch = "t3") {
-        if (fitsImm12(offset)) {
-            ss << "  sw " << src << ", " << offset << "(sp)\n";
-        } else {
-            emitSpAddr(scratch, offset, "t4");
-            ss << "  sw " << src << ", 0(" << scratch << ")\n";
-        }
+    // 切换数据段的伪指令；.sdata/.sbss/.rodata 不是汇编器都认识的名字，段属性和类型要写全，
+    // 否则 LLVM MC 会把它们当成不分配内存的段
+    static std::string sectionDirective(const std::string& section) {
+        if (section == ".data" || section == ".bss") return section;
+        if (section == ".sdata") return ".section .sdata,\"aw\",@progbits";
+        if (section == ".sbss") return ".section .sbss,\"aw\",@nobits";
+        return ".section .rodata,\"a\",@progbits";
+    }
+
+    void emit(MOpcode op, std::vector<MOperand> operands) {
+        curBlock->add(op, std::move(operands));
+    }
+
+    static MOperand R(int r) { return MOperand::reg(r); }
+    static MOperand Imm(int v) { return MOperand::imm(v); }
+
+    // sp 相对寻址都先写成 frame index，布局之后再换成真正的偏移
+    void emitFrameAddr(int dst, int fi) {
+        emit(MOpcode::ADDI, {R(dst), MOperand::frame(fi), Imm(0)});
+    }
+
+    void emitLoadFrame(int dst, int fi) {
+        emit(MOpcode::LW, {R(dst), MOperand::frame(fi), Imm(0)});
+    }
+
+    void emitStoreFrame(int src, int fi) {
+        emit(MOpcode::SW, {R(src), MOperand::frame(fi), Imm(0)});
+    }
+
+    MachineBasicBlock* getBlock(const BasicBlock* block) const {
+        return blockMap.at(block);
     }
 
     std::string getAsmBlockLabel(const std::string& irBlockName) const {
@@ -116,135 +198,404 @@ private:
         return currentFuncLabel + "_" + block;
     }
 public:
+    int optLevel = 0;//-O2 时用图着色分配寄存器
+    std::vector<std::pair<std::string, int>> peepholeStats;//每个函数被窥孔删掉的指令数
+
     std::string generate(const Program& prog) {
-    ss.str(""); 
+    ss.str("");
     ss.clear();
+    peepholeStats.clear();
     // --- 第一步：处理全局变量（数据段） ---
-    if (!prog.globalValues.empty()) {
-        ss << "  .data\n"; // 告诉汇编器，接下来的东西放数据段
-        for (const auto& val : prog.globalValues) {
-            // 晶，这里要把 Value 强转成你定义的 GlobalAlloc
-            auto* global = static_cast<GlobalAlloc*>(val.get());
-            
-            // 去掉名字开头的 '@'
-            std::string label = global->name.substr(1);
-            
-            ss << "  .globl " << label << "\n"; // 声明全局符号
-            ss << label << ":\n";               // 变量标签
-            if (global->values.empty()) {
-            // 如果是 zeroinit，根据 size * 4 填充 0
-            ss << "  .zero " << global->size * 4 << "\n";
-            } else {
-                for (int v : global->values) {
-                    ss << "  .word " << v << "\n";
-                }
-            }
-            ss << "\n";
+    // 全零的放进 .bss；标量放进 .sdata/.sbss，链接器能把按符号的 lw/sw 松弛成一条 gp 相对寻址；
+    // 常量数组放进 .rodata
+    std::string section;
+    for (const auto& val : prog.globalValues) {
+        // 晶，这里要把 Value 强转成你定义的 GlobalAlloc
+        auto* global = static_cast<GlobalAlloc*>(val.get());
+
+        // 去掉名字开头的 '@'
+        std::string label = global->name.substr(1);
+
+        bool zero = global->values.empty();
+        std::string want = isSmallGlobal(*global) ? (zero ? ".sbss" : ".sdata") : (zero ? ".bss" : ".data");
+        if (global->isConst) want = ".rodata";
+        if (want != section) {
+            section = want;
+            ss << "  " << sectionDirective(section) << "\n";
         }
+        ss << "  .globl " << label << "\n"; // 声明全局符号
+        ss << "  .p2align 2\n";             // 前面可能是运行时库里奇数长度的数据，按字对齐
+        ss << label << ":\n";               // 变量标签
+        emitInitializer(global->values, global->size);
+        ss << "\n";
     }
-    
+
 
     // --- 第二步：处理函数定义（代码段） ---
+    std::string text;
     for (const auto& func : prog.funcs) {
-        if (func->blocks.empty()) { 
-            continue; 
+        if (func->blocks.empty()) {
+            continue;
         }
-        ss << "  .text\n"; // 切换回代码段
-        ss << "  .globl " << func->name.substr(1) << "\n";
+        text += "  .text\n"; // 切换回代码段
+        text += "  .globl " + func->name.substr(1) + "\n";
         visit(*func);
-        ss << "\n";
+        printMachineFunction(*mf, text);
+        text += "\n";
     }
-    
+    ss << text;
+
     return ss.str();
 }
 
-   std::string getValRegFromStack(Value* val, const std::string& tempReg) {
-    std::string name=val->name;
+   int getValRegFromStack(Value* val, int tempReg) {
+    const std::string& name=val->name;
     if(name=="0"){
-        return "x0";
+        return ZERO;
+    }
+    auto allocated = regMap.find(name);
+    if (allocated != regMap.end()) {
+        return allocated->second;//已经在寄存器里
     }
     if (val->isGlobal()) {
-        ss << "  la " << tempReg << ", " << name.substr(1) << "\n";
-        ss << "  lw " << tempReg << ", 0(" << tempReg << ")\n";
+        emit(MOpcode::LWG, {R(tempReg), MOperand::sym(name.substr(1))});
         return tempReg;
     }
     if(name[0]=='@'||name[0]=='%'){//变量或临时变量
-        int offset = getStackOffset(name);
-        emitLoadFromSp(tempReg, offset);//从栈上加载到临时寄存器
+        emitLoadFrame(tempReg, getFrameIndex(name));//从栈上加载到临时寄存器
         return tempReg;
     }
     else{
         //立即数
-        ss << "  li " << tempReg << ", " << name << "\n";
+        emit(MOpcode::LI, {R(tempReg), Imm(std::stoi(name))});
         return tempReg;
     }
 }
 
-    int getStackOffset(const std::string& name) {
-        if (stackMap.find(name) != stackMap.end()) {
-            return stackMap[name];
+    int getFrameIndex(const std::string& name) {
+        auto it = stackMap.find(name);
+        if (it != stackMap.end()) {
+            return it->second;
         }
         throw std::runtime_error("Variable not found in stack map: " + name);
     }
 
-    std::map<std::string,int> stackMap;
-    int stackSize=0;
+    std::map<std::string,int> stackMap;//值名 -> frame index
+    std::map<std::string,int> regMap;//寄存器分配结果：值名 -> 寄存器
+
+    // 结果应该写进哪个寄存器：分到寄存器的直接写，溢出的先写 t0
+    int getDestReg(const Value& val) const {
+        auto allocated = regMap.find(val.name);
+        return allocated != regMap.end() ? allocated->second : T0;
+    }
+
+    // 把算好的结果放回它的位置（寄存器或栈槽）
+    void storeResult(const Value& val, int reg) {
+        auto allocated = regMap.find(val.name);
+        if (allocated != regMap.end()) {
+            if (allocated->second != reg) {
+                emit(MOpcode::MV, {R(allocated->second), R(reg)});
+            }
+            return;
+        }
+        emitStoreFrame(reg, getFrameIndex(val.name));
+    }
+
+    // 并行地完成一组 dst <- src 的寄存器复制，遇到环时借 t0 打断
+    void emitParallelMove(std::vector<std::pair<int, int>> moves) {
+        moves.erase(std::remove_if(moves.begin(), moves.end(),
+            [](const std::pair<int, int>& m) { return m.first == m.second; }), moves.end());
+        while (!moves.empty()) {
+            bool progressed = false;
+            for (size_t i = 0; i < moves.size(); ++i) {
+                bool dstIsSource = false;
+                for (const auto& m : moves) {
+                    if (m.second == moves[i].first) { dstIsSource = true; break; }
+                }
+                if (!dstIsSource) {
+                    emit(MOpcode::MV, {R(moves[i].first), R(moves[i].second)});
+                    moves.erase(moves.begin() + i);
+                    progressed = true;
+                    break;
+                }
+            }
+            if (!progressed) {
+                // 剩下的全在环上：先把一个源存进 t0
+                int src = moves[0].second;
+                emit(MOpcode::MV, {R(T0), R(src)});
+                for (auto& m : moves) {
+                    if (m.second == src) m.second = T0;
+                }
+            }
+        }
+    }
+
+    static bool isCompare(OpType op) {
+        return op == OpType::Lt || op == OpType::Gt || op == OpType::Le ||
+               op == OpType::Ge || op == OpType::Eq || op == OpType::Ne;
+    }
 
+    // 块末尾的 br 的条件如果是紧挨着它的比较，并且没有别的使用者，就融合成一条条件分支
+    // 比较和分支之间没有别的指令，比较的操作数此时还在原来的位置上
+    void findFusedConditions(const Function& func) {
+        fusedConditions.clear();
+        std::map<const Value*, int> useCount;
+        for (const auto& block : func.blocks) {
+            for (const auto& inst : block->insts) {
+                for (Value* op : inst->operands()) useCount[op]++;
+            }
+        }
+        for (const auto& block : func.blocks) {
+            if (block->insts.size() < 2) continue;
+            auto last = block->insts.rbegin();
+            if ((*last)->op != OpType::Br) continue;
+            const Instruction* prev = std::next(last)->get();
+            auto br = static_cast<const BranchInst*>(last->get());
+            if (br->condition == prev && isCompare(prev->op) && useCount[prev] == 1) {
+                fusedConditions.insert(prev);
+            }
+        }
+    }
+
+    // getelemptr/getptr 的所有使用者都是拿它当地址的 load/store 时，不单独算出地址：
+    //   下标是常数、基址是 alloc 或全局变量：在哪都能直接写成 偏移(基址)，使用者可以有多个
+    //   其它情况：只有一个使用者并且紧跟在后面（AddressSinking 会把它挪过来），操作数此时还在原位
+    void findFoldedAddresses(const Function& func) {
+        foldedAddrs.clear();
+        std::map<const Value*, int> useCount;
+        std::set<const Value*> otherUse;
+        for (const auto& block : func.blocks) {
+            for (const auto& inst : block->insts) {
+                for (Value* op : inst->operands()) {
+                    useCount[op]++;
+                    if (!isMemoryUserOf(*inst, op)) otherUse.insert(op);
+                }
+            }
+        }
+        for (const auto& block : func.blocks) {
+            for (auto it = block->insts.begin(); it != block->insts.end(); ++it) {
+                const Instruction* inst = it->get();
+                if (!isAddressArith(*inst) || !useCount[inst] || otherUse.count(inst)) continue;
+                Value* ptr = inst->operands()[0];
+                auto constIndex = dynamic_cast<const Integer*>(inst->operands()[1]);
+                auto ptrInst = dynamic_cast<const Instruction*>(ptr);
+                bool fixedBase = ptr->isGlobal() || (ptrInst && ptrInst->op == OpType::Alloc);
+                if (constIndex && fixedBase && fitsImm12(constIndex->value * 4)) {
+                    foldedAddrs.insert(inst);
+                    continue;
+                }
+                auto next = std::next(it);
+                if (useCount[inst] == 1 && next != block->insts.end() && isMemoryUserOf(**next, inst) &&
+                    (!constIndex || fitsImm12(constIndex->value * 4))) {
+                    foldedAddrs.insert(inst);
+                }
+            }
+        }
+    }
+
+    // call 后面紧跟 ret 它的结果时直接 tail 过去：参数不超过 8 个（不用本帧的栈传参），
+    // 并且局部变量的地址没有流出去（拆掉栈帧之后被调用者不会再访问它）
+    void findTailCalls(const Function& func) {
+        tailCalls.clear();
+        if (hasEscapingAlloc(func)) return;
+        for (const auto& block : func.blocks) {
+            if (block->insts.size() < 2) continue;
+            auto last = std::prev(block->insts.end());
+            auto call = std::prev(last);
+            if (isTailCall(**call, **last) && static_cast<const CallInst&>(**call).args.size() <= 8) {
+                tailCalls.insert(call->get());
+                tailCalls.insert(last->get());
+            }
+        }
+    }
+
+    // 给栈上的对象建 frame index：溢出的参数、alloc、溢出的值
+    void createFrameObjects(const Function& func) {
+        for (size_t i = 0; i < func.params.size(); ++i) {
+            const std::string& paramName = func.params[i].first;
+            if (i >= 8) {
+                stackMap["#arg" + std::to_string(i)] = mf->createIncomingArg((int)i - 8);
+            }
+            if (regMap.count(paramName)) continue;
+            stackMap[paramName] = mf->createFrameObject(4);
+        }
+        for(const auto& block : func.blocks) {
+            for (BlockArg* arg : block->args) {
+                if (!regMap.count(arg->name)) stackMap[arg->name] = mf->createFrameObject(4);
+            }
+            for (const auto& inst : block->insts) {
+                if (tailCalls.count(inst.get())) continue;
+                if (inst->op == OpType::Call) {
+                    mf->hasCall = true;
+                    auto callInst = static_cast<CallInst*>(inst.get());
+                    mf->maxCallArgs = std::max(mf->maxCallArgs, (int)callInst->args.size());
+                }
+                if (inst->op == OpType::Alloc) {
+                    auto alloc = static_cast<AllocInst*>(inst.get());
+                    stackMap[inst->name] = mf->createFrameObject(alloc->arraySize * 4);
+                }
+                else if (!regMap.count(inst->name) && !fusedConditions.count(inst.get()) && !foldedAddrs.count(inst.get()) &&
+                         (inst->type == Type::Int32 || inst->type == Type::Pointer)) {
+                    stackMap[inst->name] = mf->createFrameObject(4);
+                }
+            }
+        }
+        mf->raSlot = mf->hasCall ? mf->createFrameObject(4) : -1;
+    }
 
     void visit(const Function& func) {
         stackMap.clear();
-        stackSize=0;
-        isFirstBlockInCurrentFunc = true;
-        currentLayout = computeLayout(func, stackMap);
-        int total=currentLayout.total;
-        currentFuncLabel = func.name.substr(1);
-        
-        ss<<currentFuncLabel << ":\n";
-        if (total > 0) {
-        if (total <= 2048) {
-            ss << "  addi sp, sp, -" << total << "\n";
+        regMap.clear();
+        blockMap.clear();
+        std::map<std::string, std::string> allocation;
+        if (optLevel >= 2) {
+            allocation = GraphColoringAllocator().run(func);
         } else {
-            ss << "  li t0, -" << total << "\n";
-            ss << "  add sp, sp, t0\n";
+            allocation = LinearScanAllocator().run(func);
         }
-    }
-        if (currentLayout.R > 0) {
-        emitStoreToSp("ra", currentLayout.raOffset);
-    }
+        for (const auto& entry : allocation) {
+            regMap[entry.first] = regByName(entry.second);
+        }
+        currentFuncLabel = func.name.substr(1);
+        mf = std::make_unique<MachineFunction>(currentFuncLabel);
+        findFusedConditions(func);
+        findTailCalls(func);
+        findFoldedAddresses(func);
+        createFrameObjects(func);
+
+        // 先把所有块建好，前向跳转才能直接引用目标块
+        bool isFirstBlock = true;
+        for (const auto& block : func.blocks) {
+            blockMap[block.get()] = mf->createBlock(isFirstBlock ? currentFuncLabel : getAsmBlockLabel(block->name));
+            isFirstBlock = false;
+        }
+        curBlock = mf->blocks.front().get();
+
+        //先把溢出的参数存栈，再把留在寄存器里的参数挪到分配好的位置
+        std::vector<std::pair<int, int>> paramMoves;
         for (size_t i = 0; i < func.params.size(); ++i) {
-            std::string paramName = func.params[i].first;
-            int offset = getStackOffset(paramName);
+            const std::string& paramName = func.params[i].first;
+            auto allocated = regMap.find(paramName);
+            if (allocated != regMap.end()) {
+                if (i < 8) {
+                    paramMoves.push_back({allocated->second, argReg((int)i)});
+                }
+                continue;
+            }
+            int fi = getFrameIndex(paramName);
 
             if (i < 8) {
-            std::string reg = "a" + std::to_string(i);
-            emitStoreToSp(reg, offset);
+            emitStoreFrame(argReg((int)i), fi);
             }
             else {
-                int argOffset = currentLayout.total+(i - 8) * 4;
-                emitLoadFromSp("t0", argOffset);
-                emitStoreToSp("t0", offset);
+                emitLoadFrame(T0, getFrameIndex("#arg" + std::to_string(i)));
+                emitStoreFrame(T0, fi);
             }
     }
+        emitParallelMove(paramMoves);
+        for (size_t i = 8; i < func.params.size(); ++i) {
+            auto allocated = regMap.find(func.params[i].first);
+            if (allocated != regMap.end()) {
+                emitLoadFrame(allocated->second, getFrameIndex("#arg" + std::to_string(i)));
+            }
+        }
         for(const auto& block : func.blocks) {
             visit(*block);
         }
 
+        peepholeStats.push_back({currentFuncLabel, PeepholeCombiner().run(*mf)});
+        std::map<const MachineBasicBlock*, int> depth;
+        for (const auto& entry : computeLoopDepth(func)) {
+            depth[getBlock(entry.first)] = entry.second;
+        }
+        StackSlotColoring().run(*mf, depth);
+        GlobalAddressHoisting().run(*mf);
+        BlockLayout().run(*mf, depth);
+        lowerFrame();
+        BlockLayout::relaxBranches(*mf);
     }
 
+    // 布局确定之后补上序言/尾声，再把 frame index 换成 sp 偏移
+    // 序言和尾声的位置由 shrink-wrapping 决定，不一定在入口和每个 ret 前面
+    void lowerFrame() {
+        RegMask saved = usedCalleeSavedRegs(*mf);
+        for (int r = 0; r < 32; ++r) {
+            if (saved & regBit(r)) mf->calleeSavedSlots.push_back({r, mf->createFrameObject(4)});
+        }
+        StackLayout layout = computeLayout(*mf);
+        int total = layout.total;
 
-    void visit(const BasicBlock& block) {
-        bool isEntryBlock = (block.name == "%entry" || block.name == "entry");
-        if (!(isFirstBlockInCurrentFunc && isEntryBlock)) {
-            ss<<getAsmBlockLabel(block.name)<< ":\n";
+        auto adjustSp = [&](std::list<MachineInstr>& insts, std::list<MachineInstr>::iterator pos, int delta) {
+            if (fitsImm12(delta)) {
+                insts.insert(pos, MachineInstr(MOpcode::ADDI, {R(SP), R(SP), Imm(delta)}));
+            } else {
+                insts.insert(pos, MachineInstr(MOpcode::LI, {R(T0), Imm(delta)}));
+                insts.insert(pos, MachineInstr(MOpcode::ADD, {R(SP), R(SP), R(T0)}));
+            }
+        };
+
+        ShrinkWrapping wrap;
+        wrap.run(*mf, saved);
+        if (total > 0 && wrap.saveBlock) {
+            auto& prologue = wrap.saveBlock->insts;
+            auto pos = prologue.begin();
+            adjustSp(prologue, pos, -total);
+            if (mf->raSlot >= 0) {
+                prologue.insert(pos, MachineInstr(MOpcode::SW, {R(RA), MOperand::frame(mf->raSlot), Imm(0)}));
+            }
+            for (const auto& slot : mf->calleeSavedSlots) {
+                prologue.insert(pos, MachineInstr(MOpcode::SW, {R(slot.first), MOperand::frame(slot.second), Imm(0)}));
+            }
+            for (MachineBasicBlock* block : wrap.restoreBlocks) {
+                auto& insts = block->insts;
+                for (auto it = insts.begin(); it != insts.end(); ++it) {
+                    if (it->op != MOpcode::RET && it->op != MOpcode::TAIL) continue;
+                    for (const auto& slot : mf->calleeSavedSlots) {
+                        insts.insert(it, MachineInstr(MOpcode::LW, {R(slot.first), MOperand::frame(slot.second), Imm(0)}));
+                    }
+                    if (mf->raSlot >= 0) {
+                        insts.insert(it, MachineInstr(MOpcode::LW, {R(RA), MOperand::frame(mf->raSlot), Imm(0)}));
+                    }
+                    adjustSp(insts, it, total);
+                }
+            }
         }
-        isFirstBlockInCurrentFunc = false;
+
+        // frame index 只出现在 lw/sw/addi 的基址位置
+        for (auto& block : mf->blocks) {
+            auto& insts = block->insts;
+            for (auto it = insts.begin(); it != insts.end(); ++it) {
+                if (it->ops.size() < 2 || !it->ops[1].isFrameIndex()) continue;
+                int offset = mf->frameObjects[it->ops[1].value].offset + it->ops[2].value;
+                if (fitsImm12(offset)) {
+                    it->ops[1] = R(SP);
+                    it->ops[2] = Imm(offset);
+                    continue;
+                }
+                insts.insert(it, MachineInstr(MOpcode::LI, {R(T3), Imm(offset)}));
+                if (it->op == MOpcode::ADDI) {
+                    *it = MachineInstr(MOpcode::ADD, {it->ops[0], R(SP), R(T3)});
+                } else {
+                    insts.insert(it, MachineInstr(MOpcode::ADD, {R(T3), R(SP), R(T3)}));
+                    it->ops[1] = R(T3);
+                    it->ops[2] = Imm(0);
+                }
+            }
+        }
+    }
+
+
+    void visit(const BasicBlock& block) {
+        curBlock = getBlock(&block);
         for (const auto& inst : block.insts) {
             visit(*inst);
         }
     }
     void visit(const Instruction& inst) {
         if (inst.op == OpType::Ret) {
-            visitReturn(static_cast<const ReturnInst&>(inst));
+            if (!tailCalls.count(&inst)) {
+                visitReturn(static_cast<const ReturnInst&>(inst));
+            }
         }
         else if(inst.op==OpType::Alloc){
             visitAlloc(static_cast<const AllocInst&>(inst));
@@ -264,6 +615,9 @@ public:
         else if(inst.op==OpType::Call){
             visitCall(static_cast<const CallInst&>(inst));
         }
+        else if (foldedAddrs.count(&inst)) {
+            // 地址计算由使用它的 load/store 完成
+        }
         else if(inst.op==OpType::GetElemPtr){
             visitGetElemPtr(static_cast<const GetElemPtrInst&>(inst));
         }
@@ -271,7 +625,7 @@ public:
             visitGetPtr(static_cast<const GetPtrInst&>(inst));
         }
 
-         else {
+         else if (!fusedConditions.count(&inst)) {
             visitBinary(static_cast<const Binary&>(inst));
         }
     }
@@ -280,219 +634,510 @@ public:
     }
     void visitStore(const StoreInst& inst) {
     //store 10,@x.  把 10加载到临时寄存器，然后存到栈上
+    if (foldedAddrs.count(inst.address)) {
+        // 地址先算进 t1（要借用 t0），再准备要存的值
+        std::pair<MOperand, int> addr = foldAddress(*inst.address);
+        int valReg = getValRegFromStack(inst.value, T0);
+        emit(MOpcode::SW, {R(valReg), addr.first, Imm(addr.second)});
+        return;
+    }
     // 准备好要存的值
-    std::string valReg = getValRegFromStack(inst.value, "t0");
+    int valReg = getValRegFromStack(inst.value, T0);
 
     if (inst.address->isGlobal()) {
-        // 存入全局变量：la -> sw
-        ss << "  la t1, " << inst.address->name.substr(1) << "\n";
-        ss << "  sw " << valReg << ", 0(t1)\n";
-    } 
+        // 存入全局变量：sw val, sym, t1
+        emit(MOpcode::SWG, {R(valReg), MOperand::sym(inst.address->name.substr(1)), R(T1)});
+    }
     else {
         const Instruction* addrInst = dynamic_cast<const Instruction*>(inst.address);
         // 情况 A：直接存入局部标量或数组 (AllocInst)
         // 这里的地址就是 sp + offset
         if (addrInst && addrInst->op == OpType::Alloc) {
-            int offset = getStackOffset(inst.address->name);
-            emitStoreToSp(valReg, offset);
-        } 
+            emitStoreFrame(valReg, getFrameIndex(inst.address->name));
+        }
         // 情况 B：存入计算出来的地址 (GetElemPtrInst 的结果)
-        // 这里的地址值已经存在栈上了，需要先 lw 出来
+        // 地址在寄存器里或者在栈上，在栈上就先 lw 出来
         else {
-            int addrOffset = getStackOffset(inst.address->name);
-            emitLoadFromSp("t1", addrOffset); // 拿到算好的地址
-            ss << "  sw " << valReg << ", 0(t1)\n";      // 往那个地址存货
+            int addrReg = getValRegFromStack(inst.address, T1); // 拿到算好的地址
+            emit(MOpcode::SW, {R(valReg), R(addrReg), Imm(0)});   // 往那个地址存货
         }
     }
     }
-    
+
  void visitLoad(const LoadInst& inst) {
-    int offsetDest = getStackOffset(inst.name);
+    int rd = getDestReg(inst);
+    if (foldedAddrs.count(inst.address)) {
+        std::pair<MOperand, int> addr = foldAddress(*inst.address);
+        emit(MOpcode::LW, {R(rd), addr.first, Imm(addr.second)});
+    }
     // 1. 处理全局变量 (@x)
-    if (inst.address->isGlobal()) {
-        ss << "  la t0, " << inst.address->name.substr(1) << "\n"; // 拿物理地址
-        ss << "  lw t0, 0(t0)\n";                                 // 从该地址取货
-    } 
+    else if (inst.address->isGlobal()) {
+        emit(MOpcode::LWG, {R(rd), MOperand::sym(inst.address->name.substr(1))}); // 按符号直接取货
+    }
     else {
         const Instruction* addrInst = dynamic_cast<const Instruction*>(inst.address);
         // 情况 A：直接加载局部变量 (AllocInst)
         // 地址就是固定的 sp + offset
         if (addrInst && addrInst->op == OpType::Alloc) {
-            int offsetSrc = getStackOffset(inst.address->name);
-            emitLoadFromSp("t0", offsetSrc);           // 一步到位取货
-        } 
+            emitLoadFrame(rd, getFrameIndex(inst.address->name)); // 一步到位取货
+        }
         // 情况 B：从指针/GEP 结果加载 (GetElemPtrInst)
-        // 栈里存的是地址，需要两次lw
+        // 地址不在寄存器里时栈里存的是地址，需要两次lw
         else {
-            int addrOffset = getStackOffset(inst.address->name);
-            emitLoadFromSp("t1", addrOffset);         
-            ss << "  lw t0, 0(t1)\n";                             
+            int addrReg = getValRegFromStack(inst.address, T1);
+            emit(MOpcode::LW, {R(rd), R(addrReg), Imm(0)});
         }
     }
-    // 最后把取到的货 (t0) 存到目标变量在栈上的坑里
-    emitStoreToSp("t0", offsetDest);
+    // 最后把取到的货放回目标变量的位置
+    storeResult(inst, rd);
 }
     void visitBranch(const BranchInst& inst) {
         //br %cond, %then, %else
         //bnez %cond, then
         //j else
-        std::string condReg = getValRegFromStack(inst.condition,"t0");
-        ss << "  bnez " << condReg << ", "<< getAsmBlockLabel(inst.thenBlock->name) << "\n";
-        ss << "  j " << getAsmBlockLabel(inst.elseBlock->name) << "\n";
+        if (!inst.thenArgs.empty() || !inst.elseArgs.empty()) {
+            // 复制只能放在只有一个后继的块末尾，带参数的边要先拆出一个只做 jump 的块
+            throw std::runtime_error("br with block arguments must be split before code generation");
+        }
+        MOperand thenLabel = MOperand::label(getBlock(inst.thenBlock));
+        if (fusedConditions.count(inst.condition)) {
+            // 比较没有生成，直接 blt/bge/beq/bne 两个操作数
+            auto cmp = static_cast<const Binary*>(inst.condition);
+            int rs1 = getValRegFromStack(cmp->lhs, T0);
+            int rs2 = getValRegFromStack(cmp->rhs, T1);
+            MOpcode op;
+            switch (cmp->op) {
+                case OpType::Lt: op = MOpcode::BLT; break;
+                case OpType::Gt: op = MOpcode::BGT; break;
+                case OpType::Le: op = MOpcode::BLE; break;
+                case OpType::Ge: op = MOpcode::BGE; break;
+                case OpType::Eq: op = MOpcode::BEQ; break;
+                default:         op = MOpcode::BNE; break;
+            }
+            if ((op == MOpcode::BEQ || op == MOpcode::BNE) && (rs1 == ZERO || rs2 == ZERO)) {
+                int rs = rs1 == ZERO ? rs2 : rs1;
+                emit(op == MOpcode::BEQ ? MOpcode::BEQZ : MOpcode::BNEZ, {R(rs), thenLabel});
+            } else {
+                emit(op, {R(rs1), R(rs2), thenLabel});
+            }
+        } else {
+            int condReg = getValRegFromStack(inst.condition, T0);
+            emit(MOpcode::BNEZ, {R(condReg), thenLabel});
+        }
+        emit(MOpcode::J, {MOperand::label(getBlock(inst.elseBlock))});
     }
     void visitJump(const JumpInst& inst) {
-        //jump %target
-        ss << "  j " << getAsmBlockLabel(inst.targetBlock->name) << "\n";
+        //jump %target(args)：先把实参并行地复制到目标块参数的位置
+        emitBlockArgCopies(inst.targetBlock, inst.args);
+        emit(MOpcode::J, {MOperand::label(getBlock(inst.targetBlock))});
+    }
+
+    // 并行复制里的一个位置：寄存器、栈槽，或者（只作源的）立即数
+    struct CopyLoc {
+        enum Kind { InReg, InFrame, Const } kind;
+        int value;
+        bool operator==(const CopyLoc& other) const { return kind == other.kind && value == other.value; }
+    };
+
+    CopyLoc locationOf(const Value* val) {
+        if (auto constant = dynamic_cast<const Integer*>(val)) {
+            return {CopyLoc::Const, constant->value};
+        }
+        auto allocated = regMap.find(val->name);
+        if (allocated != regMap.end()) return {CopyLoc::InReg, allocated->second};
+        return {CopyLoc::InFrame, getFrameIndex(val->name)};
     }
+
+    // 块参数 <- 实参的并行复制：目标不再被别的复制读取的先做，剩下成环时把一个源挪进 t0；
+    // 栈槽到栈槽借 t1 中转，立即数不读任何位置，放在最后
+    void emitBlockArgCopies(const BasicBlock* target, const std::vector<Value*>& args) {
+        std::vector<std::pair<CopyLoc, CopyLoc>> moves;
+        std::vector<std::pair<CopyLoc, int>> constants;
+        for (size_t i = 0; i < args.size(); ++i) {
+            CopyLoc dst = locationOf(target->args[i]);
+            CopyLoc src = locationOf(args[i]);
+            if (src.kind == CopyLoc::Const) constants.push_back({dst, src.value});
+            else if (!(src == dst)) moves.push_back({dst, src});
+        }
+        auto copy = [&](CopyLoc dst, CopyLoc src) {
+            if (dst.kind == CopyLoc::InReg) {
+                if (src.kind == CopyLoc::InReg) emit(MOpcode::MV, {R(dst.value), R(src.value)});
+                else emitLoadFrame(dst.value, src.value);
+            } else {
+                int reg = src.value;
+                if (src.kind == CopyLoc::InFrame) {
+                    emitLoadFrame(T1, src.value);
+                    reg = T1;
+                }
+                emitStoreFrame(reg, dst.value);
+            }
+        };
+        while (!moves.empty()) {
+            bool progressed = false;
+            for (size_t i = 0; i < moves.size(); ++i) {
+                bool dstIsSource = false;
+                for (const auto& m : moves) {
+                    if (m.second == moves[i].first) { dstIsSource = true; break; }
+                }
+                if (!dstIsSource) {
+                    copy(moves[i].first, moves[i].second);
+                    moves.erase(moves.begin() + i);
+                    progressed = true;
+                    break;
+                }
+            }
+            if (!progressed) {
+                CopyLoc src = moves[0].second;
+                CopyLoc temp{CopyLoc::InReg, T0};
+                copy(temp, src);
+                for (auto& m : moves) {
+                    if (m.second == src) m.second = temp;
+                }
+            }
+        }
+        for (const auto& c : constants) {
+            int reg = c.first.kind == CopyLoc::InReg ? c.first.value : T1;
+            if (c.second == 0 && c.first.kind == CopyLoc::InFrame) reg = ZERO;
+            else emit(MOpcode::LI, {R(reg), Imm(c.second)});
+            if (c.first.kind == CopyLoc::InFrame) emitStoreFrame(reg, c.first.value);
+        }
+    }
+    // 常数操作数能放进 12 位立即数时，直接选 addi/andi/ori/xori/slti，省掉 li
+    bool selectImmediate(const Binary& inst) {
+        auto lhsConst = dynamic_cast<const Integer*>(inst.lhs);
+        auto rhsConst = dynamic_cast<const Integer*>(inst.rhs);
+        if (!rhsConst && !lhsConst) return false;
+        bool commutative = inst.op == OpType::Add || inst.op == OpType::AND || inst.op == OpType::OR ||
+                           inst.op == OpType::Eq || inst.op == OpType::Ne;
+        Value* var = inst.lhs;
+        long long c;
+        bool constOnLeft = false;
+        if (rhsConst) {
+            c = rhsConst->value;
+        } else {
+            // 常数在左边：可交换的直接换过来，比较换成反方向
+            c = lhsConst->value;
+            var = inst.rhs;
+            constOnLeft = true;
+        }
+
+        MOpcode op;
+        long long imm = c;
+        bool negate = false;   // 结果再取一次反（seqz）
+        bool testNonZero = false; // 结果再 snez
+        OpType kind = inst.op;
+        if (constOnLeft && !commutative) {
+            // C < x 即 x > C，C > x 即 x < C，依此类推
+            if (kind == OpType::Lt) kind = OpType::Gt;
+            else if (kind == OpType::Gt) kind = OpType::Lt;
+            else if (kind == OpType::Le) kind = OpType::Ge;
+            else if (kind == OpType::Ge) kind = OpType::Le;
+            else return false;
+        }
+        switch (kind) {
+            case OpType::Add: op = MOpcode::ADDI; break;
+            case OpType::Sub: op = MOpcode::ADDI; imm = -c; break;
+            case OpType::AND: op = MOpcode::ANDI; break;
+            case OpType::OR:  op = MOpcode::ORI;  break;
+            case OpType::Eq:  op = MOpcode::XORI; negate = true; break;
+            case OpType::Ne:  op = MOpcode::XORI; testNonZero = true; break;
+            case OpType::Lt:  op = MOpcode::SLTI; break;
+            case OpType::Ge:  op = MOpcode::SLTI; negate = true; break;           // x >= C 即 !(x < C)
+            case OpType::Le:  op = MOpcode::SLTI; imm = c + 1; break;            // x <= C 即 x < C + 1
+            case OpType::Gt:  op = MOpcode::SLTI; imm = c + 1; negate = true; break; // x > C 即 !(x < C + 1)
+            default: return false;
+        }
+        if (imm < -2048 || imm > 2047) return false;
+
+        int rs = getValRegFromStack(var, T0);
+        int rd = getDestReg(inst);
+        emit(op, {R(rd), R(rs), Imm((int)imm)});
+        if (negate) {
+            emit(MOpcode::SEQZ, {R(rd), R(rd)});
+        } else if (testNonZero) {
+            emit(MOpcode::SNEZ, {R(rd), R(rd)});
+        }
+        storeResult(inst, rd);
+        return true;
+    }
+
+    // 乘除模常数：乘 2 的幂（或 2^k±1）用移位，除模 2 的幂用带偏置的移位，其余除模用 mulh 魔数
+    bool selectStrengthReduced(const Binary& inst) {
+        if (inst.op != OpType::Mul && inst.op != OpType::Div && inst.op != OpType::Mod) return false;
+        auto rhsConst = dynamic_cast<const Integer*>(inst.rhs);
+        auto lhsConst = dynamic_cast<const Integer*>(inst.lhs);
+        Value* var = inst.lhs;
+        if (!rhsConst && inst.op == OpType::Mul && lhsConst) {
+            rhsConst = lhsConst;
+            var = inst.rhs;
+        }
+        if (!rhsConst) return false;
+        int c = rhsConst->value;
+        if (c == 0) return false;  // 除以 0 留给硬件
+        uint32_t absC = c < 0 ? 0u - (uint32_t)c : (uint32_t)c;
+        int k = log2Exact(absC);
+        if (inst.op == OpType::Mul) return selectMulByConst(inst, var, c, absC, k);
+
+        int rs = getValRegFromStack(var, T0);
+        int rd = getDestReg(inst);
+        if (absC == 1) {
+            // x / 1 = x，x / -1 = -x，x % ±1 = 0
+            if (inst.op == OpType::Mod) emit(MOpcode::MV, {R(rd), R(ZERO)});
+            else emit(c > 0 ? MOpcode::MV : MOpcode::NEG, {R(rd), R(rs)});
+            storeResult(inst, rd);
+            return true;
+        }
+        if (k > 0) {
+            // 负数要先加上 2^k - 1 才能做到向零取整：t1 = x + ((x >> 31) >>> (32 - k))
+            if (k == 1) {
+                emit(MOpcode::SRLI, {R(T1), R(rs), Imm(31)});
+            } else {
+                emit(MOpcode::SRAI, {R(T1), R(rs), Imm(31)});
+                emit(MOpcode::SRLI, {R(T1), R(T1), Imm(32 - k)});
+            }
+            emit(MOpcode::ADD, {R(T1), R(rs), R(T1)});
+            if (inst.op == OpType::Div) {
+                emit(MOpcode::SRAI, {R(rd), R(T1), Imm(k)});
+                if (c < 0) emit(MOpcode::NEG, {R(rd), R(rd)});
+            } else {
+                // x % 2^k = x - (t1 & -2^k)，余数的符号和除数无关
+                int mask = (int)(0u - ((uint32_t)1 << k));
+                if (fitsImm12(mask)) {
+                    emit(MOpcode::ANDI, {R(T1), R(T1), Imm(mask)});
+                } else {
+                    emit(MOpcode::LI, {R(T4), Imm(mask)});
+                    emit(MOpcode::AND, {R(T1), R(T1), R(T4)});
+                }
+                emit(MOpcode::SUB, {R(rd), R(rs), R(T1)});
+            }
+            storeResult(inst, rd);
+            return true;
+        }
+
+        // 一般的常数：q = mulh(x, M)，修正后右移 s 位，再加上 q 的符号位完成向零取整
+        DivMagic magic = computeDivMagic(c);
+        emit(MOpcode::LI, {R(T1), Imm(magic.M)});
+        emit(MOpcode::MULH, {R(T1), R(rs), R(T1)});
+        if (c > 0 && magic.M < 0) emit(MOpcode::ADD, {R(T1), R(T1), R(rs)});
+        if (c < 0 && magic.M > 0) emit(MOpcode::SUB, {R(T1), R(T1), R(rs)});
+        if (magic.s > 0) emit(MOpcode::SRAI, {R(T1), R(T1), Imm(magic.s)});
+        emit(MOpcode::SRLI, {R(T4), R(T1), Imm(31)});
+        if (inst.op == OpType::Div) {
+            emit(MOpcode::ADD, {R(rd), R(T1), R(T4)});
+        } else {
+            // x % c = x - q * c
+            emit(MOpcode::ADD, {R(T1), R(T1), R(T4)});
+            emit(MOpcode::LI, {R(T4), Imm(c)});
+            emit(MOpcode::MUL, {R(T1), R(T1), R(T4)});
+            emit(MOpcode::SUB, {R(rd), R(rs), R(T1)});
+        }
+        storeResult(inst, rd);
+        return true;
+    }
+
+    // 乘常数：只在不多于 li + mul 的指令数时改写（负数多一条 neg）
+    bool selectMulByConst(const Binary& inst, Value* var, int c, uint32_t absC, int k) {
+        int shift = __builtin_ctz(absC);
+        uint32_t odd = absC >> shift;
+        int plus = log2Exact(odd - 1);   // odd = 2^plus + 1
+        int minus = log2Exact(odd + 1);  // odd = 2^minus - 1
+        if (k < 0 && !(shift == 0 && (plus > 0 || minus > 0))) return false;
+
+        int rs = getValRegFromStack(var, T0);
+        int rd = getDestReg(inst);
+        if (k == 0) {
+            emit(c > 0 ? MOpcode::MV : MOpcode::NEG, {R(rd), R(rs)});
+            storeResult(inst, rd);
+            return true;
+        }
+        if (k > 0) {
+            emit(MOpcode::SLLI, {R(rd), R(rs), Imm(k)});
+        } else {
+            // x * (2^k ± 1) = (x << k) ± x
+            emit(MOpcode::SLLI, {R(T1), R(rs), Imm(plus > 0 ? plus : minus)});
+            emit(plus > 0 ? MOpcode::ADD : MOpcode::SUB, {R(rd), R(T1), R(rs)});
+        }
+        if (c < 0) emit(MOpcode::NEG, {R(rd), R(rd)});
+        storeResult(inst, rd);
+        return true;
+    }
+
     void visitBinary(const Binary& inst) {
-        std::string rs1= getValRegFromStack(inst.lhs,"t0");
-        std::string rs2= getValRegFromStack(inst.rhs,"t1");
+        if (selectStrengthReduced(inst) || selectImmediate(inst)) {
+            return;
+        }
+        int rs1= getValRegFromStack(inst.lhs, T0);
+        int rs2= getValRegFromStack(inst.rhs, T1);
+        int rd = getDestReg(inst);
 
         if (inst.op == OpType::Sub) {
-            ss << "  sub t0, " <<rs1 << ", " << rs2 << "\n";
-        } 
+            emit(MOpcode::SUB, {R(rd), R(rs1), R(rs2)});
+        }
         else if (inst.op == OpType::Add) {
-            ss << "  add t0, " << rs1 << ", " << rs2 << "\n";
+            emit(MOpcode::ADD, {R(rd), R(rs1), R(rs2)});
         }
         else if (inst.op == OpType::Eq) {
-            ss << "  xor t0, " << rs1 << ", " << rs2 << "\n";
-            ss << "  seqz t0, " << "t0" << "\n";
+            emit(MOpcode::XOR, {R(rd), R(rs1), R(rs2)});
+            emit(MOpcode::SEQZ, {R(rd), R(rd)});
         }
         else if (inst.op == OpType::Mul) {
-            ss << "  mul t0, " << rs1 << ", " << rs2 << "\n";
+            emit(MOpcode::MUL, {R(rd), R(rs1), R(rs2)});
         }
         else if (inst.op == OpType::Div) {
-            ss << "  div t0, " << rs1 << ", " << rs2 << "\n";
+            emit(MOpcode::DIV, {R(rd), R(rs1), R(rs2)});
         }
         else if (inst.op == OpType::Mod) {
-            ss << "  rem t0, " << rs1 << ", " << rs2 << "\n";
+            emit(MOpcode::REM, {R(rd), R(rs1), R(rs2)});
         }
         else if (inst.op == OpType::Lt) {
-            ss << "  slt t0, " << rs1 << ", " << rs2 << "\n";
+            emit(MOpcode::SLT, {R(rd), R(rs1), R(rs2)});
         }
         else if (inst.op == OpType::Gt) {
-            ss << "  sgt t0, " << rs1 << ", " << rs2 << "\n";
+            emit(MOpcode::SGT, {R(rd), R(rs1), R(rs2)});
         }
         else if (inst.op == OpType::Le) {
-            ss << "  sgt t0, " << rs1 << ", " << rs2 << "\n";
-            ss << "  seqz t0, " << "t0" << "\n";
+            emit(MOpcode::SGT, {R(rd), R(rs1), R(rs2)});
+            emit(MOpcode::SEQZ, {R(rd), R(rd)});
         }
         else if (inst.op == OpType::Ge) {
-            ss << "  slt t0, " << rs1 << ", " << rs2 << "\n";
-            ss << "  seqz t0, " << "t0" << "\n";
+            emit(MOpcode::SLT, {R(rd), R(rs1), R(rs2)});
+            emit(MOpcode::SEQZ, {R(rd), R(rd)});
         }
         else if (inst.op == OpType::Ne) {
-            ss << "  xor t0, " << rs1 << ", " << rs2 << "\n";
-            ss << "  snez t0, " << "t0" << "\n";
+            emit(MOpcode::XOR, {R(rd), R(rs1), R(rs2)});
+            emit(MOpcode::SNEZ, {R(rd), R(rd)});
         }
         else if (inst.op == OpType::AND) {
-            ss << "  and t0, " << rs1 << ", " << rs2 << "\n";
+            emit(MOpcode::AND, {R(rd), R(rs1), R(rs2)});
         }
         else if (inst.op == OpType::OR) {
-            ss << "  or t0, " << rs1 << ", " << rs2 << "\n";
+            emit(MOpcode::OR, {R(rd), R(rs1), R(rs2)});
         }
-        int offset = getStackOffset(inst.name);
-        emitStoreToSp("t0", offset);
+        storeResult(inst, rd);
 
     }
     void visitReturn(const ReturnInst& inst) {
-       if (inst.retValue) { 
-        std::string valReg = getValRegFromStack(inst.retValue, "a0");
-        if (valReg != "a0") {
-            ss << "  mv a0, " << valReg << "\n";
+       if (inst.retValue) {
+        int valReg = getValRegFromStack(inst.retValue, A0);
+        if (valReg != A0) {
+            emit(MOpcode::MV, {R(A0), R(valReg)});
         }
         }
-        if (currentLayout.R > 0) {
-        emitLoadFromSp("ra", currentLayout.raOffset);
-    }
-        int total=currentLayout.total;
-        if (total > 0) {
-            if (total <= 2048) {
-            ss << "  addi sp, sp, " << total << "\n";
-            }
-            else {
-            ss << "  li t0, " << total << "\n";
-            ss << "  add sp, sp, t0\n";
-            }
+        // 恢复 ra 和 sp 留给 lowerFrame
+        emit(MOpcode::RET, {});
     }
-        ss << "  ret\n";
-    }
-    
+
     void visitCall(const CallInst& inst) {
         int argCount = inst.args.size();
+        //先把第 8 个以后的参数存到栈上，这时 a 寄存器还没被改写
+        if (argCount > 8) {
+        for (int i = 8; i < argCount; ++i) {
+            int srcReg = getValRegFromStack(inst.args[i], T0);
+            emit(MOpcode::SW, {R(srcReg), R(SP), Imm((i - 8) * 4)});
+        }
+    }
+        //在寄存器里的参数可能互相占着对方的 a 寄存器，统一做并行复制
+        std::vector<std::pair<int, int>> moves;
         for (int i = 0; i < std::min(argCount, 8); ++i) {
-
-        std::string targetReg = "a" + std::to_string(i);
-        std::string srcReg = getValRegFromStack(inst.args[i], targetReg);
+            auto allocated = regMap.find(inst.args[i]->name);
+            if (allocated != regMap.end()) {
+                moves.push_back({argReg(i), allocated->second});
+            }
+        }
+        emitParallelMove(moves);
+        //剩下的参数（栈上的值、立即数）直接装进目标寄存器
+        for (int i = 0; i < std::min(argCount, 8); ++i) {
+        if (regMap.count(inst.args[i]->name)) {
+            continue;
+        }
+        int targetReg = argReg(i);
+        int srcReg = getValRegFromStack(inst.args[i], targetReg);
 
          if (srcReg != targetReg) {
-            ss << "  mv " << targetReg << ", " << srcReg << "\n";
+            emit(MOpcode::MV, {R(targetReg), R(srcReg)});
         }
         }
 
-        if (argCount > 8) {
-        for (int i = 8; i < argCount; ++i) {
-            std::string srcReg = getValRegFromStack(inst.args[i], "t0");
-            int offset = (i - 8) * 4; 
-            emitStoreToSp(srcReg, offset);
+        if (tailCalls.count(&inst)) {
+            // 被调用者直接返回到我们的调用者，ra 和 sp 的恢复由 lowerFrame 插在 tail 前面
+            emit(MOpcode::TAIL, {MOperand::sym(inst.funcName.substr(1)), Imm(std::min(argCount, 8))});
+            return;
         }
-    }
-
-        ss << "  call " << inst.funcName.substr(1) << "\n";
+        emit(MOpcode::CALL, {MOperand::sym(inst.funcName.substr(1)), Imm(std::min(argCount, 8))});
 
         if (inst.type != Type::Void) {
-            int offset = getStackOffset(inst.name);
-            emitStoreToSp("a0", offset);
+            storeResult(inst, A0);
         }
     }
 
-    void visitGetElemPtr(const GetElemPtrInst& inst) {
-    // 1. 获取基地址（放到 t0）
-    if (inst.ptr->isGlobal()) {
-        ss << "  la t0, " << inst.ptr->name.substr(1) << "\n";
-    } else {
-        const Instruction* ptrInst = dynamic_cast<const Instruction*>(inst.ptr);
-
+    // 把 getelemptr/getptr 的基地址放进寄存器
+    int getBaseAddrReg(Value* ptr, int tempReg) {
+        if (ptr->isGlobal()) {
+            emit(MOpcode::LA, {R(tempReg), MOperand::sym(ptr->name.substr(1))});
+            return tempReg;
+        }
+        const Instruction* ptrInst = dynamic_cast<const Instruction*>(ptr);
         if (ptrInst && ptrInst->op == OpType::Alloc) {
-            int offset = getStackOffset(inst.ptr->name);
-            emitSpAddr("t0", offset);
-        } else {
-            // 如果不是 alloc（比如是上一个 GEP 算出的地址），
-            // 那么这个“值”本身就存在栈上，我们需要用 lw 把它读出来
-            int offset = getStackOffset(inst.ptr->name);
-            emitLoadFromSp("t0", offset);
-        }
-    }
-    // 2. 获取下标并计算偏移（逻辑保持不变）
-    std::string idxReg = getValRegFromStack(inst.index, "t1");
-    ss << "  slli t1, " << idxReg << ", 2\n"; // t1 = idx * 4
-    ss << "  add t0, t0, t1\n";              // t0 = 基址 + 偏移
-    // 3. 将算出的地址存回栈
-    int destOffset = getStackOffset(inst.name);
-    emitStoreToSp("t0", destOffset);
-}
+            emitFrameAddr(tempReg, getFrameIndex(ptr->name));
+            return tempReg;
+        }
+        // 如果不是 alloc（比如是上一个 GEP 算出的地址），
+        // 那么这个“值”本身就在寄存器或者栈上
+        return getValRegFromStack(ptr, tempReg);
+    }
 
-    void visitGetPtr(const GetPtrInst& inst) {
-    // getptr 与 getelemptr 在当前实现中都是基址 + idx * 4
-    if (inst.ptr->isGlobal()) {
-        ss << "  la t0, " << inst.ptr->name.substr(1) << "\n";
-    } else {
-        const Instruction* ptrInst = dynamic_cast<const Instruction*>(inst.ptr);
+    // 折叠掉的 getelemptr/getptr 在访存处的地址：返回 lw/sw 的 基址（寄存器或 frame index）和偏移
+    // 用 t1 放基址，t0 放下标
+    std::pair<MOperand, int> foldAddress(const Value& addr) {
+        const auto& inst = static_cast<const Instruction&>(addr);
+        Value* ptr = inst.operands()[0];
+        Value* index = inst.operands()[1];
+        if (auto constIndex = dynamic_cast<const Integer*>(index)) {
+            const Instruction* ptrInst = dynamic_cast<const Instruction*>(ptr);
+            if (ptrInst && ptrInst->op == OpType::Alloc) {
+                return {MOperand::frame(getFrameIndex(ptr->name)), constIndex->value * 4};
+            }
+            return {R(getBaseAddrReg(ptr, T1)), constIndex->value * 4};
+        }
+        int baseReg = getBaseAddrReg(ptr, T1);
+        int idxReg = getValRegFromStack(index, T0);
+        emit(MOpcode::SLLI, {R(T0), R(idxReg), Imm(2)});
+        emit(MOpcode::ADD, {R(T1), R(baseReg), R(T0)});
+        return {R(T1), 0};
+    }
 
+    // getptr 与 getelemptr 在当前实现中都是基址 + idx * 4
+    void visitPtrArith(const Value& inst, Value* ptr, Value* index) {
+    int rd = getDestReg(inst);
+    auto constIndex = dynamic_cast<const Integer*>(index);
+    if (constIndex && fitsImm12(constIndex->value * 4)) {
+        // 下标是常数：偏移直接当 addi 的立即数，alloc 的基址连同偏移一起留给 frame index
+        int offset = constIndex->value * 4;
+        const Instruction* ptrInst = dynamic_cast<const Instruction*>(ptr);
         if (ptrInst && ptrInst->op == OpType::Alloc) {
-            int offset = getStackOffset(inst.ptr->name);
-            emitSpAddr("t0", offset);
+            emit(MOpcode::ADDI, {R(rd), MOperand::frame(getFrameIndex(ptr->name)), Imm(offset)});
         } else {
-            int offset = getStackOffset(inst.ptr->name);
-            emitLoadFromSp("t0", offset);
+            int baseReg = getBaseAddrReg(ptr, T0);
+            emit(MOpcode::ADDI, {R(rd), R(baseReg), Imm(offset)});
         }
+        storeResult(inst, rd);
+        return;
     }
+    // 1. 获取基地址
+    int baseReg = getBaseAddrReg(ptr, T0);
+    // 2. 获取下标并计算偏移
+    int idxReg = getValRegFromStack(index, T1);
+    emit(MOpcode::SLLI, {R(T1), R(idxReg), Imm(2)}); // t1 = idx * 4
+    // 3. 基址 + 偏移，写回结果的位置
+    emit(MOpcode::ADD, {R(rd), R(baseReg), R(T1)});
+    storeResult(inst, rd);
+}
 
-    std::string idxReg = getValRegFromStack(inst.index, "t1");
-    ss << "  slli t1, " << idxReg << ", 2\n";
-    ss << "  add t0, t0, t1\n";
+    void visitGetElemPtr(const GetElemPtrInst& inst) {
+        visitPtrArith(inst, inst.ptr, inst.index);
+    }
 
-    int destOffset = getStackOffset(inst.name);
-    emitStoreToSp("t0", destOffset);
-}
-};
\ No newline at end of file
+    void visitGetPtr(const GetPtrInst& inst) {
+        visitPtrArith(inst, inst.ptr, inst.index);
+    }
+};
@@ -0,0 +1,701 @@
+#pragma once
+#include "ir.hpp"
+#include "Liveness.hpp"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// 参与分配的寄存器：t0/t1 留给溢出值的装载，t3 留给大偏移寻址，t4 留给常数除法的展开
+// 前面是 caller-saved，优先分配；后面是 callee-saved 的 s0~s11，跨过 call 的值只能放在这里，
+// 用到哪个 s 寄存器，序言里就保存哪个
+inline std::vector<std::string> allocatableRegs() {
+    return {"t2", "t5", "t6", "a7", "a6", "a5", "a4", "a3", "a2", "a1", "a0",
+            "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11"};
+}
+
+inline bool isCalleeSavedReg(const std::string& reg) {
+    return reg.size() >= 2 && reg[0] == 's' && reg != "sp";
+}
+
+// 第一次用到一个 s 寄存器要在序言和尾声里各多一条 sw/lw；
+// 溢出代价不超过它的值宁可留在栈上，除非有已经保存过的 s 寄存器可用
+constexpr double kCalleeSaveCost = 2;
+
+// 每个基本块的循环嵌套深度：DFS 找回边，再沿前驱收集自然循环
+inline std::map<const BasicBlock*, int> computeLoopDepth(const Function& func) {
+    std::map<const BasicBlock*, int> depth;
+    if (func.blocks.empty()) {
+        return depth;
+    }
+    std::map<const BasicBlock*, std::vector<const BasicBlock*>> preds;
+    for (const auto& block : func.blocks) {
+        depth[block.get()] = 0;
+        for (BasicBlock* succ : successorsOf(*block)) {
+            preds[succ].push_back(block.get());
+        }
+    }
+
+    std::vector<std::pair<const BasicBlock*, const BasicBlock*>> backEdges; // latch -> header
+    std::map<const BasicBlock*, int> state; // 1 在栈上，2 已完成
+    std::vector<std::pair<const BasicBlock*, size_t>> stack;
+    stack.push_back({func.blocks.front().get(), 0});
+    state[func.blocks.front().get()] = 1;
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        auto succs = successorsOf(*top.first);
+        if (top.second == succs.size()) {
+            state[top.first] = 2;
+            stack.pop_back();
+            continue;
+        }
+        const BasicBlock* succ = succs[top.second++];
+        if (state[succ] == 1) {
+            backEdges.push_back({top.first, succ});
+        } else if (state[succ] == 0) {
+            state[succ] = 1;
+            stack.push_back({succ, 0});
+        }
+    }
+
+    // 同一个循环头的回边合并成一个循环
+    std::map<const BasicBlock*, std::set<const BasicBlock*>> loops;
+    for (const auto& edge : backEdges) {
+        auto& body = loops[edge.second];
+        body.insert(edge.second);
+        std::vector<const BasicBlock*> work;
+        if (body.insert(edge.first).second) {
+            work.push_back(edge.first);
+        }
+        while (!work.empty()) {
+            const BasicBlock* b = work.back();
+            work.pop_back();
+            for (const BasicBlock* p : preds[b]) {
+                if (body.insert(p).second) {
+                    work.push_back(p);
+                }
+            }
+        }
+    }
+    for (const auto& loop : loops) {
+        for (const BasicBlock* b : loop.second) {
+            depth[b]++;
+        }
+    }
+    return depth;
+}
+
+// 线性扫描用的区间 [start, end]，位置编号和 Liveness 一致
+struct LiveInterval {
+    const Value* val;
+    int start;
+    int end;
+    std::string reg;        // 为空表示溢出到栈上
+    int paramIndex = -1;    // 是第几个参数，-1 表示不是参数
+    double spillCost = 0;   // 定义和使用的次数，按循环深度加权
+};
+
+class LinearScanAllocator {
+public:
+    std::vector<std::string> pool = allocatableRegs();
+
+    // 返回 值名 -> 物理寄存器，没出现在结果里的值留在栈上
+    std::map<std::string, std::string> run(const Function& func) {
+        buildIntervals(func);
+        allocate();
+        std::map<std::string, std::string> result;
+        for (const auto& it : intervals) {
+            if (!it.reg.empty()) {
+                result[it.val->name] = it.reg;
+            }
+        }
+        return result;
+    }
+
+private:
+    std::vector<LiveInterval> intervals;
+    std::vector<int> callPositions;
+
+    void buildIntervals(const Function& func) {
+        intervals.clear();
+        callPositions.clear();
+
+        std::map<std::string, int> paramIndex;
+        for (size_t i = 0; i < func.params.size(); ++i) {
+            paramIndex[func.params[i].first] = (int)i;
+        }
+
+        // 不处理区间里的空洞，直接取活跃范围的首尾
+        Liveness live(func);
+        for (int id = 0; id < live.numValues(); ++id) {
+            const LiveRange& range = live.range(id);
+            if (range.empty()) continue;
+            LiveInterval li{live.value(id), range.start(), range.end()};
+            auto param = paramIndex.find(li.val->name);
+            if (dynamic_cast<const Parameter*>(li.val) && param != paramIndex.end()) {
+                li.paramIndex = param->second;
+            }
+            intervals.push_back(li);
+        }
+        std::map<const Value*, double> cost;
+        auto loopDepth = computeLoopDepth(func);
+        for (const auto& block : func.blocks) {
+            double w = 1;
+            for (int d = std::min(loopDepth[block.get()], 8); d > 0; --d) w *= 10;
+            for (BlockArg* arg : block->args) cost[arg] += w;
+            for (const auto& inst : block->insts) {
+                cost[inst.get()] += w;
+                for (Value* op : inst->operands()) cost[op] += w;
+            }
+        }
+        for (auto& li : intervals) {
+            li.spillCost = cost[li.val] + (li.paramIndex >= 0 ? 1 : 0);
+        }
+        const auto& order = live.linearOrder();
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (order[i]->op == OpType::Call) {
+                callPositions.push_back(2 * (int)i);
+            }
+        }
+    }
+
+    bool crossesCall(const LiveInterval& li) const {
+        auto it = std::upper_bound(callPositions.begin(), callPositions.end(), li.start);
+        return it != callPositions.end() && *it < li.end;
+    }
+
+    // Poletto & Sarkar 的线性扫描：寄存器不够时溢出结束得最晚的区间
+    void allocate() {
+        std::sort(intervals.begin(), intervals.end(), [](const LiveInterval& a, const LiveInterval& b) {
+            return a.start < b.start || (a.start == b.start && a.end < b.end);
+        });
+
+        std::vector<LiveInterval*> active;  // 按 end 升序
+        std::set<std::string> freeRegs(pool.begin(), pool.end());
+        std::set<std::string> usedCalleeSaved;
+
+        // 跨过 call 的区间只能用 s 寄存器
+        auto usable = [](const std::string& reg, bool acrossCall) {
+            return !acrossCall || isCalleeSavedReg(reg);
+        };
+        auto takeReg = [&](LiveInterval& li, bool acrossCall) {
+            // 参数尽量留在传进来的 a 寄存器里，省掉序言里的 mv
+            if (!acrossCall && li.paramIndex >= 0 && li.paramIndex < 8) {
+                std::string hint = "a" + std::to_string(li.paramIndex);
+                if (freeRegs.count(hint)) {
+                    freeRegs.erase(hint);
+                    return hint;
+                }
+            }
+            // caller-saved 优先，其次是已经保存过的 s 寄存器，不划算就不再开新的
+            std::string chosen;
+            for (const auto& r : pool) {
+                if (!usable(r, acrossCall) || !freeRegs.count(r)) continue;
+                if (!isCalleeSavedReg(r) || usedCalleeSaved.count(r)) { chosen = r; break; }
+                if (chosen.empty()) chosen = r;
+            }
+            if (chosen.empty() || (isCalleeSavedReg(chosen) && !usedCalleeSaved.count(chosen) &&
+                                   li.spillCost <= kCalleeSaveCost)) {
+                return std::string();
+            }
+            freeRegs.erase(chosen);
+            if (isCalleeSavedReg(chosen)) usedCalleeSaved.insert(chosen);
+            return chosen;
+        };
+        auto addActive = [&](LiveInterval* li) {
+            auto pos = std::upper_bound(active.begin(), active.end(), li,
+                [](const LiveInterval* a, const LiveInterval* b) { return a->end < b->end; });
+            active.insert(pos, li);
+        };
+
+        for (auto& cur : intervals) {
+            while (!active.empty() && active.front()->end < cur.start) {
+                freeRegs.insert(active.front()->reg);
+                active.erase(active.begin());
+            }
+            bool acrossCall = crossesCall(cur);
+            std::string reg = takeReg(cur, acrossCall);
+            if (!reg.empty()) {
+                cur.reg = reg;
+                addActive(&cur);
+                continue;
+            }
+            // 从结束得最晚的开始找一个寄存器 cur 也能用的区间
+            auto victim = active.end();
+            while (victim != active.begin()) {
+                --victim;
+                if (usable((*victim)->reg, acrossCall)) break;
+            }
+            if (victim != active.end() && usable((*victim)->reg, acrossCall) && (*victim)->end > cur.end) {
+                cur.reg = (*victim)->reg;
+                (*victim)->reg.clear();
+                active.erase(victim);
+                addActive(&cur);
+            }
+        }
+    }
+};
+
+// -O2 用的图着色分配（Appel 的 iterated register coalescing）
+// 物理寄存器是预着色结点；参数、call 的实参/返回值、ret 的值和对应 a 寄存器之间
+// 记一条 move，能合并就直接分到那个 a 寄存器，省掉 visitCall 等处的 mv
+// 块参数和跳转时传给它的实参之间也记 move，合并之后跳转前的复制就没了
+class GraphColoringAllocator {
+public:
+    std::vector<std::string> pool = allocatableRegs();
+
+    std::map<std::string, std::string> run(const Function& func) {
+        build(func);
+        makeWorklist();
+        while (!simplifyWorklist.empty() || !worklistMoves.empty() ||
+               !freezeWorklist.empty() || !spillWorklist.empty()) {
+            if (!simplifyWorklist.empty()) simplify();
+            else if (!worklistMoves.empty()) coalesce();
+            else if (!freezeWorklist.empty()) freeze();
+            else selectSpill();
+        }
+        assignColors();
+
+        std::map<std::string, std::string> result;
+        for (int n = K; n < (int)nodeValue.size(); ++n) {
+            if (color[n] >= 0) {
+                result[nodeValue[n]->name] = pool[color[n]];
+            }
+        }
+        return result;
+    }
+
+private:
+    enum class NodeState { Precolored, Initial, Simplify, Freeze, Spill, Spilled, Coalesced, Colored, Selected };
+    enum class MoveState { Worklist, Active, Coalesced, Constrained, Frozen };
+
+    int K = 0;
+    std::vector<const Value*> nodeValue;        // 下标 < K 的是物理寄存器
+    std::map<const Value*, int> nodeOf;
+    std::vector<NodeState> state;
+    std::vector<std::vector<int>> adjList;
+    std::vector<bool> adjSet;                   // 下三角位矩阵，(u, v) 在 u > v 时位于 u*(u-1)/2+v
+    std::vector<int> degree;
+    std::vector<int> alias;
+    std::vector<int> color;
+    std::vector<double> spillCost;
+
+    std::vector<std::pair<int, int>> moves;
+    std::vector<MoveState> moveState;
+    std::vector<std::vector<int>> moveList;
+
+    std::set<int> simplifyWorklist, freezeWorklist, spillWorklist, worklistMoves;
+    std::vector<int> selectStack;
+
+    bool precolored(int n) const { return n < K; }
+
+    int nodeFor(const Value* v) {
+        auto it = nodeOf.find(v);
+        if (it != nodeOf.end()) {
+            return it->second;
+        }
+        int n = (int)nodeValue.size();
+        nodeOf[v] = n;
+        nodeValue.push_back(v);
+        state.push_back(NodeState::Initial);
+        adjList.emplace_back();
+        adjSet.resize((size_t)(n + 1) * n / 2);
+        degree.push_back(0);
+        alias.push_back(n);
+        color.push_back(-1);
+        spillCost.push_back(0);
+        moveList.emplace_back();
+        return n;
+    }
+
+    static size_t edgeIndex(int u, int v) {
+        if (u < v) std::swap(u, v);
+        return (size_t)u * (u - 1) / 2 + v;
+    }
+
+    bool interferes(int u, int v) const {
+        return u != v && adjSet[edgeIndex(u, v)];
+    }
+
+    void addEdge(int u, int v) {
+        if (u == v || adjSet[edgeIndex(u, v)]) {
+            return;
+        }
+        adjSet[edgeIndex(u, v)] = true;
+        if (!precolored(u)) { adjList[u].push_back(v); degree[u]++; }
+        if (!precolored(v)) { adjList[v].push_back(u); degree[v]++; }
+    }
+
+    void addMove(int value, int reg) {
+        int m = (int)moves.size();
+        moves.push_back({value, reg});
+        moveState.push_back(MoveState::Worklist);
+        moveList[value].push_back(m);
+        moveList[reg].push_back(m);
+        worklistMoves.insert(m);
+    }
+
+    int regNode(const std::string& reg) const {
+        for (int i = 0; i < K; ++i) {
+            if (pool[i] == reg) return i;
+        }
+        return -1;
+    }
+
+    void build(const Function& func) {
+        K = (int)pool.size();
+        nodeValue.assign(K, nullptr);
+        nodeOf.clear();
+        state.assign(K, NodeState::Precolored);
+        adjList.assign(K, {});
+        adjSet.assign((size_t)K * (K - 1) / 2, false);
+        degree.assign(K, 1 << 30);
+        alias.resize(K);
+        color.resize(K);
+        for (int i = 0; i < K; ++i) { alias[i] = i; color[i] = i; }
+        spillCost.assign(K, 0);
+        moves.clear();
+        moveState.clear();
+        moveList.assign(K, {});
+        simplifyWorklist.clear();
+        freezeWorklist.clear();
+        spillWorklist.clear();
+        worklistMoves.clear();
+        selectStack.clear();
+
+        Liveness live(func);
+        // 按活跃分析的编号缓存结点，连边时不用每次查 nodeOf
+        std::vector<int> liveNodes(live.numValues(), -1);
+        auto liveNode = [&](int id) {
+            if (liveNodes[id] < 0) liveNodes[id] = nodeFor(live.value(id));
+            return liveNodes[id];
+        };
+        auto loopDepth = computeLoopDepth(func);
+        auto weight = [&](const BasicBlock* b) {
+            double w = 1;
+            for (int d = std::min(loopDepth[b], 8); d > 0; --d) w *= 10;
+            return w;
+        };
+
+        // 参数在入口处同时定义
+        std::map<std::string, int> paramIndex;
+        for (size_t i = 0; i < func.params.size(); ++i) {
+            paramIndex[func.params[i].first] = (int)i;
+        }
+        if (live.numBlocks() > 0) {
+            std::vector<int> params;
+            live.liveIn(0).forEach([&](int id) {
+                const Value* v = live.value(id);
+                int n = nodeFor(v);
+                params.push_back(n);
+                spillCost[n] += 1;
+                auto idx = paramIndex.find(v->name);
+                if (idx != paramIndex.end() && idx->second < 8) {
+                    addMove(n, regNode("a" + std::to_string(idx->second)));
+                }
+            });
+            for (size_t i = 0; i < params.size(); ++i) {
+                for (size_t j = i + 1; j < params.size(); ++j) {
+                    addEdge(params[i], params[j]);
+                }
+            }
+        }
+
+        for (int b = 0; b < live.numBlocks(); ++b) {
+            const BasicBlock* block = live.block(b);
+            double w = weight(block);
+            BitSet liveNow = live.liveOut(b);
+            for (auto it = block->insts.rbegin(); it != block->insts.rend(); ++it) {
+                const Instruction* inst = it->get();
+                int defId = live.idOf(inst);
+                if (defId >= 0) {
+                    int d = nodeFor(inst);
+                    spillCost[d] += w;
+                    liveNow.reset(defId);
+                    liveNow.forEach([&](int id) { addEdge(d, liveNode(id)); });
+                }
+                if (inst->op == OpType::Call) {
+                    // 跨过 call 的值和所有 caller-saved 寄存器冲突，只能分到 s 寄存器
+                    liveNow.forEach([&](int id) {
+                        int n = liveNode(id);
+                        for (int r = 0; r < K; ++r) {
+                            if (!isCalleeSavedReg(pool[r])) addEdge(n, r);
+                        }
+                    });
+                    auto call = static_cast<const CallInst*>(inst);
+                    for (size_t i = 0; i < call->args.size() && i < 8; ++i) {
+                        if (isRegCandidate(call->args[i])) {
+                            addMove(nodeFor(call->args[i]), regNode("a" + std::to_string(i)));
+                        }
+                    }
+                    if (isRegCandidate(inst)) {
+                        addMove(nodeFor(inst), regNode("a0"));
+                    }
+                }
+                if (inst->op == OpType::Jump) {
+                    auto jump = static_cast<const JumpInst*>(inst);
+                    for (size_t i = 0; i < jump->args.size(); ++i) {
+                        if (isRegCandidate(jump->args[i])) {
+                            addMove(nodeFor(jump->targetBlock->args[i]), nodeFor(jump->args[i]));
+                        }
+                    }
+                }
+                if (inst->op == OpType::Ret) {
+                    auto ret = static_cast<const ReturnInst*>(inst);
+                    if (ret->retValue && isRegCandidate(ret->retValue)) {
+                        addMove(nodeFor(ret->retValue), regNode("a0"));
+                    }
+                }
+                for (Value* op : inst->operands()) {
+                    int id = live.idOf(op);
+                    if (id >= 0) {
+                        spillCost[nodeFor(op)] += w;
+                        liveNow.set(id);
+                    }
+                }
+            }
+            // 块参数在块首同时定义（复制发生在前驱的跳转处），
+            // 和此处活跃的值、和彼此都冲突，没被用到的块参数也一样，免得复制时写坏别的值
+            std::vector<int> args;
+            for (BlockArg* arg : block->args) {
+                int d = nodeFor(arg);
+                spillCost[d] += w;
+                args.push_back(d);
+                int id = live.idOf(arg);
+                if (id >= 0) liveNow.reset(id);
+            }
+            for (size_t i = 0; i < args.size(); ++i) {
+                liveNow.forEach([&](int id) { addEdge(args[i], liveNode(id)); });
+                for (size_t j = i + 1; j < args.size(); ++j) addEdge(args[i], args[j]);
+            }
+        }
+    }
+
+    std::vector<int> adjacent(int n) const {
+        std::vector<int> result;
+        for (int m : adjList[n]) {
+            if (state[m] != NodeState::Selected && state[m] != NodeState::Coalesced) {
+                result.push_back(m);
+            }
+        }
+        return result;
+    }
+
+    std::vector<int> nodeMoves(int n) const {
+        std::vector<int> result;
+        for (int m : moveList[n]) {
+            if (moveState[m] == MoveState::Active || moveState[m] == MoveState::Worklist) {
+                result.push_back(m);
+            }
+        }
+        return result;
+    }
+
+    bool moveRelated(int n) const { return !nodeMoves(n).empty(); }
+
+    void setState(int n, NodeState s) {
+        switch (state[n]) {
+            case NodeState::Simplify: simplifyWorklist.erase(n); break;
+            case NodeState::Freeze: freezeWorklist.erase(n); break;
+            case NodeState::Spill: spillWorklist.erase(n); break;
+            default: break;
+        }
+        state[n] = s;
+        switch (s) {
+            case NodeState::Simplify: simplifyWorklist.insert(n); break;
+            case NodeState::Freeze: freezeWorklist.insert(n); break;
+            case NodeState::Spill: spillWorklist.insert(n); break;
+            default: break;
+        }
+    }
+
+    void makeWorklist() {
+        for (int n = K; n < (int)nodeValue.size(); ++n) {
+            if (degree[n] >= K) setState(n, NodeState::Spill);
+            else if (moveRelated(n)) setState(n, NodeState::Freeze);
+            else setState(n, NodeState::Simplify);
+        }
+    }
+
+    void enableMoves(int n) {
+        for (int m : nodeMoves(n)) {
+            if (moveState[m] == MoveState::Active) {
+                moveState[m] = MoveState::Worklist;
+                worklistMoves.insert(m);
+            }
+        }
+    }
+
+    void decrementDegree(int m) {
+        if (precolored(m)) {
+            return;
+        }
+        int d = degree[m]--;
+        if (d == K) {
+            enableMoves(m);
+            for (int n : adjacent(m)) enableMoves(n);
+            setState(m, moveRelated(m) ? NodeState::Freeze : NodeState::Simplify);
+        }
+    }
+
+    void simplify() {
+        int n = *simplifyWorklist.begin();
+        setState(n, NodeState::Selected);
+        selectStack.push_back(n);
+        for (int m : adjacent(n)) decrementDegree(m);
+    }
+
+    int getAlias(int n) const {
+        while (state[n] == NodeState::Coalesced) n = alias[n];
+        return n;
+    }
+
+    void addWorklist(int u) {
+        if (!precolored(u) && !moveRelated(u) && degree[u] < K) {
+            setState(u, NodeState::Simplify);
+        }
+    }
+
+    bool ok(int t, int r) const {
+        return degree[t] < K || precolored(t) || interferes(t, r);
+    }
+
+    bool conservative(const std::vector<int>& nodes) const {
+        std::set<int> seen;
+        int k = 0;
+        for (int n : nodes) {
+            if (seen.insert(n).second && degree[n] >= K) k++;
+        }
+        return k < K;
+    }
+
+    void combine(int u, int v) {
+        setState(v, NodeState::Coalesced);
+        alias[v] = u;
+        moveList[u].insert(moveList[u].end(), moveList[v].begin(), moveList[v].end());
+        enableMoves(v);
+        for (int t : adjacent(v)) {
+            addEdge(t, u);
+            decrementDegree(t);
+        }
+        if (!precolored(u) && degree[u] >= K && state[u] == NodeState::Freeze) {
+            setState(u, NodeState::Spill);
+        }
+    }
+
+    void coalesce() {
+        int m = *worklistMoves.begin();
+        worklistMoves.erase(m);
+        int x = getAlias(moves[m].first);
+        int y = getAlias(moves[m].second);
+        int u = x, v = y;
+        if (precolored(y)) { u = y; v = x; }
+
+        if (u == v) {
+            moveState[m] = MoveState::Coalesced;
+            addWorklist(u);
+        } else if (precolored(v) || interferes(u, v)) {
+            moveState[m] = MoveState::Constrained;
+            addWorklist(u);
+            addWorklist(v);
+        } else {
+            bool canCombine;
+            if (precolored(u)) {
+                canCombine = true;
+                for (int t : adjacent(v)) {
+                    if (!ok(t, u)) { canCombine = false; break; }
+                }
+            } else {
+                std::vector<int> nodes = adjacent(u);
+                std::vector<int> vs = adjacent(v);
+                nodes.insert(nodes.end(), vs.begin(), vs.end());
+                canCombine = conservative(nodes);
+            }
+            if (canCombine) {
+                moveState[m] = MoveState::Coalesced;
+                combine(u, v);
+                addWorklist(u);
+            } else {
+                moveState[m] = MoveState::Active;
+            }
+        }
+    }
+
+    void freezeMoves(int u) {
+        for (int m : nodeMoves(u)) {
+            int x = moves[m].first, y = moves[m].second;
+            int v = getAlias(y) == getAlias(u) ? getAlias(x) : getAlias(y);
+            if (moveState[m] == MoveState::Worklist) worklistMoves.erase(m);
+            moveState[m] = MoveState::Frozen;
+            if (!precolored(v) && state[v] == NodeState::Freeze && !moveRelated(v) && degree[v] < K) {
+                setState(v, NodeState::Simplify);
+            }
+        }
+    }
+
+    void freeze() {
+        int u = *freezeWorklist.begin();
+        setState(u, NodeState::Simplify);
+        freezeMoves(u);
+    }
+
+    // 溢出代价按循环深度加权，优先溢出代价/度数最小的
+    void selectSpill() {
+        int best = -1;
+        double bestScore = 0;
+        for (int n : spillWorklist) {
+            double score = spillCost[n] / std::max(degree[n], 1);
+            if (best < 0 || score < bestScore) {
+                best = n;
+                bestScore = score;
+            }
+        }
+        setState(best, NodeState::Simplify);
+        freezeMoves(best);
+    }
+
+    void assignColors() {
+        std::vector<char> usedCalleeSaved(K, 0);
+        while (!selectStack.empty()) {
+            int n = selectStack.back();
+            selectStack.pop_back();
+            std::vector<bool> okColors(K, true);
+            for (int w : adjList[n]) {
+                int a = getAlias(w);
+                if (state[a] == NodeState::Colored || precolored(a)) {
+                    okColors[color[a]] = false;
+                }
+            }
+            // 有 move 关系的对方已经有颜色时，尽量选同一个
+            int chosen = -1;
+            for (int m : moveList[n]) {
+                int other = getAlias(moves[m].first) == n ? getAlias(moves[m].second) : getAlias(moves[m].first);
+                if (color[other] >= 0 && (state[other] == NodeState::Colored || precolored(other)) && okColors[color[other]]) {
+                    chosen = color[other];
+                    break;
+                }
+            }
+            // caller-saved 优先，其次是已经保存过的 s 寄存器，代价够高才开新的 s 寄存器
+            for (int c = 0; c < K && chosen < 0; ++c) {
+                if (okColors[c] && (!isCalleeSavedReg(pool[c]) || usedCalleeSaved[c])) chosen = c;
+            }
+            for (int c = 0; c < K && chosen < 0 && spillCost[n] > kCalleeSaveCost; ++c) {
+                if (okColors[c]) chosen = c;
+            }
+            if (chosen < 0) {
+                state[n] = NodeState::Spilled;
+            } else {
+                state[n] = NodeState::Colored;
+                color[n] = chosen;
+                usedCalleeSaved[chosen] = 1;
+            }
+        }
+        for (int n = K; n < (int)nodeValue.size(); ++n) {
+            if (state[n] == NodeState::Coalesced) {
+                int a = getAlias(n);
+                color[n] = (state[a] == NodeState::Colored || precolored(a)) ? color[a] : -1;
+            }
+        }
+    }
+};
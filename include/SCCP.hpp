@@ -0,0 +1,243 @@
+#pragma once
+#include "ir.hpp"
+#include <climits>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 两个整数常数做二元运算；除 0 和溢出的除法留到运行时，返回 false
+inline bool foldBinary(OpType op, int l, int r, int& result) {
+    auto ul = (uint32_t)l, ur = (uint32_t)r;
+    switch (op) {
+        case OpType::Add: result = (int)(ul + ur); return true;
+        case OpType::Sub: result = (int)(ul - ur); return true;
+        case OpType::Mul: result = (int)(ul * ur); return true;
+        case OpType::Div:
+        case OpType::Mod:
+            if (r == 0 || (l == INT_MIN && r == -1)) return false;
+            result = op == OpType::Div ? l / r : l % r;
+            return true;
+        case OpType::Eq: result = l == r; return true;
+        case OpType::Ne: result = l != r; return true;
+        case OpType::Lt: result = l < r; return true;
+        case OpType::Gt: result = l > r; return true;
+        case OpType::Le: result = l <= r; return true;
+        case OpType::Ge: result = l >= r; return true;
+        case OpType::AND: result = l & r; return true;
+        case OpType::OR: result = l | r; return true;
+        default: return false;
+    }
+}
+
+// 稀疏条件常量传播（Wegman-Zadeck），跑在 mem2reg 之后的 SSA 上：
+//   格：未定 -> 常数 -> 不是常数，只往下走
+//   块只有在某条可执行的边到达后才算可执行；br 的条件是常数时只走一边；
+//   块参数取所有可执行的入边上实参的交汇
+// 收敛后：结果是常数的指令和块参数换成常数删掉，条件是常数的 br 改成 jump，不可执行的块删掉
+class SCCP {
+public:
+    bool run(Program& prog) {
+        bool changed = false;
+        for (auto& func : prog.funcs) {
+            changed |= run(*func);
+        }
+        return changed;
+    }
+
+    bool run(Function& func) {
+        if (func.blocks.empty()) return false;
+        lattice.clear();
+        executable.clear();
+        users.clear();
+        parent.clear();
+        blockWork.clear();
+        valueWork.clear();
+
+        for (auto& block : func.blocks) {
+            for (auto& inst : block->insts) {
+                parent[inst.get()] = block.get();
+                for (Value* op : inst->operands()) users[op].push_back(inst.get());
+            }
+        }
+        markExecutable(func.blocks.front().get());
+        while (!blockWork.empty() || !valueWork.empty()) {
+            while (!blockWork.empty()) {
+                BasicBlock* block = blockWork.back();
+                blockWork.pop_back();
+                for (auto& inst : block->insts) visit(inst.get());
+            }
+            while (!valueWork.empty()) {
+                const Value* v = valueWork.back();
+                valueWork.pop_back();
+                auto it = users.find(v);
+                if (it == users.end()) continue;
+                for (Instruction* user : it->second) {
+                    if (executable.count(parent.at(user))) visit(user);
+                }
+            }
+        }
+        return rewrite(func);
+    }
+
+private:
+    struct Lattice {
+        enum Kind { Undef, Const, Overdefined } kind = Undef;
+        int value = 0;
+    };
+
+    std::unordered_map<const Value*, Lattice> lattice;
+    std::unordered_set<const BasicBlock*> executable;
+    std::unordered_map<const Value*, std::vector<Instruction*>> users;
+    std::unordered_map<const Instruction*, BasicBlock*> parent;
+    std::vector<BasicBlock*> blockWork;
+    std::vector<const Value*> valueWork;
+
+    Lattice get(const Value* v) const {
+        if (auto c = dynamic_cast<const Integer*>(v)) return {Lattice::Const, c->value};
+        auto it = lattice.find(v);
+        if (it != lattice.end()) return it->second;
+        // 块参数和二元运算还没算到时是未定，其余的值（函数参数、load、call 等）都不是常数
+        if (dynamic_cast<const BlockArg*>(v) || dynamic_cast<const Binary*>(v)) return {};
+        return {Lattice::Overdefined, 0};
+    }
+
+    // 和 v 当前的格值取交汇，变了就让用到 v 的指令重新算
+    void lower(const Value* v, Lattice next) {
+        Lattice cur = get(v);
+        if (cur.kind == Lattice::Overdefined || next.kind == Lattice::Undef) return;
+        if (cur.kind == Lattice::Const) {
+            if (next.kind == Lattice::Const && next.value == cur.value) return;
+            next = {Lattice::Overdefined, 0};
+        }
+        lattice[v] = next;
+        valueWork.push_back(v);
+    }
+
+    void markExecutable(BasicBlock* block) {
+        if (executable.insert(block).second) blockWork.push_back(block);
+    }
+
+    void flowEdge(BasicBlock* target, const std::vector<Value*>& args) {
+        for (size_t i = 0; i < args.size(); ++i) lower(target->args[i], get(args[i]));
+        markExecutable(target);
+    }
+
+    void visit(Instruction* inst) {
+        switch (inst->op) {
+            case OpType::Br: {
+                auto br = static_cast<BranchInst*>(inst);
+                Lattice cond = get(br->condition);
+                if (cond.kind == Lattice::Undef) return;
+                if (cond.kind == Lattice::Overdefined || cond.value != 0) flowEdge(br->thenBlock, br->thenArgs);
+                if (cond.kind == Lattice::Overdefined || cond.value == 0) flowEdge(br->elseBlock, br->elseArgs);
+                return;
+            }
+            case OpType::Jump: {
+                auto jump = static_cast<JumpInst*>(inst);
+                flowEdge(jump->targetBlock, jump->args);
+                return;
+            }
+            default:
+                break;
+        }
+        auto binary = dynamic_cast<Binary*>(inst);
+        if (!binary) {
+            if (inst->type != Type::Void) lower(inst, {Lattice::Overdefined, 0});
+            return;
+        }
+        Lattice l = get(binary->lhs), r = get(binary->rhs);
+        // x * 0 和 x & 0 不管 x 是多少都是 0
+        bool zeroing = binary->op == OpType::Mul || binary->op == OpType::AND;
+        if (zeroing && ((l.kind == Lattice::Const && l.value == 0) || (r.kind == Lattice::Const && r.value == 0))) {
+            lower(inst, {Lattice::Const, 0});
+            return;
+        }
+        if (l.kind == Lattice::Overdefined || r.kind == Lattice::Overdefined) {
+            lower(inst, {Lattice::Overdefined, 0});
+            return;
+        }
+        if (l.kind == Lattice::Undef || r.kind == Lattice::Undef) return;
+        int result;
+        if (foldBinary(binary->op, l.value, r.value, result)) {
+            lower(inst, {Lattice::Const, result});
+        } else {
+            lower(inst, {Lattice::Overdefined, 0});
+        }
+    }
+
+    bool rewrite(Function& func) {
+        bool changed = false;
+        BasicBlock* entry = func.blocks.front().get();
+        std::unordered_map<int, Integer*> constants;
+        auto constant = [&](int v) {
+            auto& c = constants[v];
+            if (!c) {
+                c = new Integer(v);
+                entry->addValue(c);
+            }
+            return c;
+        };
+
+        // 常数结果：先记下来，统一替换
+        std::unordered_map<const Value*, Value*> replaced;
+        for (auto& item : lattice) {
+            if (item.second.kind == Lattice::Const) replaced[item.first] = constant(item.second.value);
+        }
+
+        std::vector<BasicBlock*> dead;
+        std::unordered_map<const BasicBlock*, std::vector<JumpInst*>> incoming;
+        for (auto& block : func.blocks) {
+            if (!executable.count(block.get())) {
+                dead.push_back(block.get());
+                continue;
+            }
+            for (auto it = block->insts.begin(); it != block->insts.end();) {
+                Instruction* inst = it->get();
+                if (replaced.count(inst)) {
+                    it = block->insts.erase(it);
+                    changed = true;
+                    continue;
+                }
+                for (Value* op : inst->operands()) {
+                    auto r = replaced.find(op);
+                    if (r != replaced.end()) inst->replaceOperand(op, r->second);
+                }
+                ++it;
+            }
+
+            Instruction* term = block->insts.back().get();
+            if (term->op == OpType::Br) {
+                auto br = static_cast<BranchInst*>(term);
+                Lattice cond = get(br->condition);
+                if (cond.kind == Lattice::Const) {
+                    auto jump = cond.value != 0 ? new JumpInst(br->thenBlock, br->thenArgs)
+                                                : new JumpInst(br->elseBlock, br->elseArgs);
+                    block->insts.back().reset(jump);
+                    term = jump;
+                    changed = true;
+                }
+            }
+            if (term->op == OpType::Jump) {
+                auto jump = static_cast<JumpInst*>(term);
+                incoming[jump->targetBlock].push_back(jump);
+            }
+        }
+
+        // 值是常数的块参数已经被换掉了，连同各个入边上对应的实参一起删掉
+        for (auto& block : func.blocks) {
+            if (!executable.count(block.get())) continue;
+            auto& args = block->args;
+            for (size_t i = args.size(); i-- > 0;) {
+                if (!replaced.count(args[i])) continue;
+                for (JumpInst* jump : incoming[block.get()]) jump->args.erase(jump->args.begin() + i);
+                args.erase(args.begin() + i);
+                changed = true;
+            }
+        }
+
+        if (changed || !dead.empty()) func.invalidateCFG();
+        for (BasicBlock* block : dead) func.removeBlock(block);
+        return changed || !dead.empty();
+    }
+};
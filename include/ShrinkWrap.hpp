@@ -0,0 +1,143 @@
+#pragma once
+#include "MachineIR.hpp"
+#include <vector>
+
+// 函数里写过的 callee-saved 寄存器（sp 除外），序言要保存它们
+inline RegMask usedCalleeSavedRegs(const MachineFunction& mf) {
+    RegMask used = 0;
+    for (const auto& block : mf.blocks) {
+        for (const auto& mi : block->insts) {
+            if (mi.format() != MFormat::Call) used |= defMask(mi);
+        }
+    }
+    return used & calleeSavedMask() & ~regBit(SP);
+}
+
+// 序言/尾声的放置（shrink-wrapping）
+//   需要栈帧的块：访问栈对象或 sp、有 call、读写要保存的 s 寄存器
+//   序言放在支配这些块的最近的块 S 上，并且要求 S 不在循环里、从 S 能走到的块都被 S 支配，
+//   这样每条路径要么经过一次序言，要么根本不碰栈帧；尾声只插在 S 能走到的 ret/tail 前面
+//   递归的出口这类提前返回的路径就不用调整 sp，也不用保存 ra 和 s 寄存器
+class ShrinkWrapping {
+public:
+    MachineBasicBlock* saveBlock = nullptr;         // 放序言的块，nullptr 表示不需要栈帧
+    std::vector<MachineBasicBlock*> restoreBlocks;  // 要在 ret/tail 前放尾声的块
+
+    void run(MachineFunction& mf, RegMask savedRegs) {
+        saved = savedRegs;
+        saveBlock = nullptr;
+        restoreBlocks.clear();
+        if (mf.blocks.empty()) return;
+        sinkEntryCopies(mf);
+
+        MachineCFG cfg(mf);
+        int n = (int)cfg.blocks.size();
+        MachineDominators dom(cfg);
+        int save = -1;
+        bool allReachable = true;
+        for (int b = 0; b < n; ++b) {
+            if (!dom.reachable(b)) { allReachable = false; continue; }
+            if (needsFrame(*cfg.blocks[b])) save = save < 0 ? b : dom.commonDominator(save, b);
+        }
+        if (save < 0) return;
+        if (!allReachable) save = 0;  // 有不可达的块时保守地放在入口
+        std::vector<char> region;
+        while (save != 0 && !isSingleEntryRegion(cfg, dom, save, region)) {
+            save = dom.idom[save];
+        }
+        if (save == 0) region.assign(n, 1);
+
+        saveBlock = cfg.blocks[save];
+        for (int b = 0; b < n; ++b) {
+            if (region[b]) restoreBlocks.push_back(cfg.blocks[b]);
+        }
+    }
+
+private:
+    RegMask saved = 0;
+
+    bool needsFrame(const MachineBasicBlock& block) const {
+        for (const auto& mi : block.insts) {
+            if (mi.op == MOpcode::CALL) return true;
+            for (const auto& op : mi.ops) {
+                if (op.isFrameIndex() || (op.isReg() && op.value == SP)) return true;
+            }
+            if (mi.format() != MFormat::Call && ((defMask(mi) | explicitUseMask(mi)) & saved)) return true;
+        }
+        return false;
+    }
+
+    // 从 s 出发能走到的块都被 s 支配，并且走不回 s（s 不在循环里）
+    static bool isSingleEntryRegion(const MachineCFG& cfg, const MachineDominators& dom, int s,
+                                    std::vector<char>& region) {
+        region.assign(cfg.blocks.size(), 0);
+        region[s] = 1;
+        std::vector<int> work{s};
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            for (int succ : cfg.succs[b]) {
+                if (succ == s || !dom.dominates(s, succ)) return false;
+                if (!region[succ]) {
+                    region[succ] = 1;
+                    work.push_back(succ);
+                }
+            }
+        }
+        return true;
+    }
+
+    // 入口里把参数挪进 s 寄存器的 mv 会让入口本身需要栈帧，序言就没法往下放：
+    //   mv sX, aY 之后入口里对 sX 的使用改成直接用 aY，
+    //   sX 只在一个后继里活跃、并且那个后继只有入口一个前驱时，把 mv 挪到那个后继的开头
+    void sinkEntryCopies(MachineFunction& mf) {
+        MachineBasicBlock& entry = *mf.blocks.front();
+        for (const auto& mi : entry.insts) {
+            if (mi.op == MOpcode::CALL) return;
+        }
+        auto isCopyToSaved = [&](const MachineInstr& mi) {
+            return mi.op == MOpcode::MV && (regBit(mi.ops[0].value) & saved) && !(regBit(mi.ops[1].value) & saved);
+        };
+        // 之后 dst 和 src 都没被改写时，入口里对 dst 的使用换成 src
+        for (auto it = entry.insts.begin(); it != entry.insts.end(); ++it) {
+            if (!isCopyToSaved(*it)) continue;
+            int dst = it->ops[0].value, src = it->ops[1].value;
+            bool redefined = false;
+            for (auto next = std::next(it); next != entry.insts.end(); ++next) {
+                if (defMask(*next) & (regBit(dst) | regBit(src))) redefined = true;
+            }
+            if (redefined) continue;
+            for (auto next = std::next(it); next != entry.insts.end(); ++next) {
+                for (auto& op : next->ops) {
+                    if (op.isReg() && op.value == dst) op.value = src;
+                }
+            }
+        }
+
+        MachineCFG cfg(mf);
+        if (cfg.succs[0].size() < 2) return;
+        std::vector<RegMask> in = RegLiveness(cfg, explicitUseMask).liveIn;
+        std::vector<std::list<MachineInstr>::iterator> insertPos(cfg.blocks.size());
+        for (int s : cfg.succs[0]) insertPos[s] = cfg.blocks[s]->insts.begin();
+        for (auto it = entry.insts.begin(); it != entry.insts.end();) {
+            auto cur = it++;
+            if (!isCopyToSaved(*cur)) continue;
+            RegMask dst = regBit(cur->ops[0].value), src = regBit(cur->ops[1].value);
+            bool blocked = false;
+            for (auto next = std::next(cur); next != entry.insts.end(); ++next) {
+                if ((defMask(*next) & (dst | src)) || (explicitUseMask(*next) & dst)) blocked = true;
+            }
+            if (blocked) continue;
+            int target = -1, liveCount = 0;
+            for (int s : cfg.succs[0]) {
+                if (in[s] & dst) { target = s; liveCount++; }
+            }
+            if (liveCount == 0) {
+                entry.insts.erase(cur);
+            } else if (liveCount == 1 && target != 0 && cfg.preds[target].size() == 1) {
+                // 按原来的顺序接在之前挪过去的 mv 后面
+                cfg.blocks[target]->insts.splice(insertPos[target], entry.insts, cur);
+            }
+        }
+    }
+};
@@ -0,0 +1,178 @@
+#pragma once
+#include "MachineIR.hpp"
+#include "Liveness.hpp"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+// 能单独分析的栈槽：4 字节、不是调用者传进来的参数、地址没有被取过（只通过 lw/sw 直接访问）
+// 返回 frame index -> 栈槽编号，不跟踪的是 -1
+inline std::vector<int> trackedFrameSlots(const MachineFunction& mf, int& numSlots) {
+    std::vector<char> addressTaken(mf.frameObjects.size(), 0);
+    for (const auto& block : mf.blocks) {
+        for (const auto& mi : block->insts) {
+            if (mi.op != MOpcode::LW && mi.op != MOpcode::SW) {
+                for (const auto& op : mi.ops) {
+                    if (op.isFrameIndex()) addressTaken[op.value] = 1;
+                }
+            }
+        }
+    }
+    std::vector<int> slotId(mf.frameObjects.size(), -1);
+    numSlots = 0;
+    for (size_t fi = 0; fi < mf.frameObjects.size(); ++fi) {
+        const FrameObject& obj = mf.frameObjects[fi];
+        if (obj.size == 4 && !obj.incoming && (int)fi != mf.raSlot && !addressTaken[fi]) {
+            slotId[fi] = numSlots++;
+        }
+    }
+    return slotId;
+}
+
+// lw/sw 访问的跟踪栈槽，不是就返回 -1
+inline int accessedSlot(const MachineInstr& mi, const std::vector<int>& slotId) {
+    if ((mi.op != MOpcode::LW && mi.op != MOpcode::SW) || !mi.ops[1].isFrameIndex() || mi.ops[2].value != 0) {
+        return -1;
+    }
+    return slotId[mi.ops[1].value];
+}
+
+// 栈槽的活跃分析：lw 是使用，sw 是定义
+class SlotLiveness {
+public:
+    MachineCFG cfg;
+    std::vector<int> slotId;
+    int numSlots = 0;
+
+    explicit SlotLiveness(const MachineFunction& mf) : cfg(mf) {
+        slotId = trackedFrameSlots(mf, numSlots);
+        solve();
+    }
+
+    int slotOf(const MachineInstr& mi) const { return accessedSlot(mi, slotId); }
+    const BitSet& liveIn(int b) const { return in[b]; }
+    const BitSet& liveOut(int b) const { return out[b]; }
+
+private:
+    std::vector<BitSet> in, out;
+
+    void solve() {
+        int n = (int)cfg.blocks.size();
+        std::vector<BitSet> use(n, BitSet(numSlots)), def(n, BitSet(numSlots));
+        in.assign(n, BitSet(numSlots));
+        out.assign(n, BitSet(numSlots));
+        for (int b = 0; b < n; ++b) {
+            for (const auto& mi : cfg.blocks[b]->insts) {
+                int slot = slotOf(mi);
+                if (slot < 0) continue;
+                if (mi.op == MOpcode::LW && !def[b].test(slot)) use[b].set(slot);
+                if (mi.op == MOpcode::SW) def[b].set(slot);
+            }
+        }
+        bool iterate = true;
+        while (iterate) {
+            iterate = false;
+            for (int b = n - 1; b >= 0; --b) {
+                for (int s : cfg.succs[b]) out[b].unionWith(in[s]);
+                iterate |= in[b].assignTransfer(use[b], out[b], def[b]);
+            }
+        }
+    }
+};
+
+// 栈槽共享：活跃范围不相交的栈槽合并成一个，按访问频率贪心着色，
+// 热的栈槽先拿到颜色，布局时排在低地址，偏移能放进 12 位立即数
+class StackSlotColoring {
+public:
+    // depth: 每个块的循环嵌套深度，用来估计访问频率
+    void run(MachineFunction& mf, const std::map<const MachineBasicBlock*, int>& depth) {
+        computeWeights(mf, depth);
+        SlotLiveness live(mf);
+        int n = live.numSlots;
+        if (n < 2) return;
+
+        std::vector<int> frameOf(n);
+        for (size_t fi = 0; fi < live.slotId.size(); ++fi) {
+            if (live.slotId[fi] >= 0) frameOf[live.slotId[fi]] = (int)fi;
+        }
+
+        // 在每个 sw 处，被写的栈槽和此刻活跃的其它栈槽冲突
+        std::vector<std::vector<int>> adj(n);
+        auto addEdge = [&](int a, int b) {
+            if (a == b) return;
+            adj[a].push_back(b);
+            adj[b].push_back(a);
+        };
+        for (int b = 0; b < (int)live.cfg.blocks.size(); ++b) {
+            BitSet cur = live.liveOut(b);
+            const auto& insts = live.cfg.blocks[b]->insts;
+            for (auto it = insts.rbegin(); it != insts.rend(); ++it) {
+                int slot = live.slotOf(*it);
+                if (slot < 0) continue;
+                if (it->op == MOpcode::SW) {
+                    cur.forEach([&](int other) { addEdge(slot, other); });
+                    cur.reset(slot);
+                } else {
+                    cur.set(slot);
+                }
+            }
+        }
+        // 入口处就活跃的栈槽（没写就读）两两冲突
+        if (!live.cfg.blocks.empty()) {
+            std::vector<int> entryLive;
+            live.liveIn(0).forEach([&](int s) { entryLive.push_back(s); });
+            for (size_t i = 0; i < entryLive.size(); ++i) {
+                for (size_t j = i + 1; j < entryLive.size(); ++j) addEdge(entryLive[i], entryLive[j]);
+            }
+        }
+
+        std::vector<int> order(n);
+        for (int i = 0; i < n; ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return mf.frameObjects[frameOf[a]].weight > mf.frameObjects[frameOf[b]].weight;
+        });
+        std::vector<int> color(n, -1);
+        std::vector<int> colorFrame;     // 每个颜色用第一个拿到它的栈槽当代表
+        std::vector<int> mark;
+        for (int s : order) {
+            mark.assign(colorFrame.size(), 0);
+            for (int t : adj[s]) {
+                if (color[t] >= 0) mark[color[t]] = 1;
+            }
+            int c = 0;
+            while (c < (int)colorFrame.size() && mark[c]) ++c;
+            if (c == (int)colorFrame.size()) {
+                colorFrame.push_back(frameOf[s]);
+            } else {
+                mf.frameObjects[colorFrame[c]].weight += mf.frameObjects[frameOf[s]].weight;
+            }
+            color[s] = c;
+        }
+
+        for (auto& block : mf.blocks) {
+            for (auto& mi : block->insts) {
+                for (auto& op : mi.ops) {
+                    if (op.isFrameIndex() && live.slotId[op.value] >= 0) {
+                        op.value = colorFrame[color[live.slotId[op.value]]];
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    // 每个栈对象的访问次数，按 10^循环深度 加权
+    static void computeWeights(MachineFunction& mf, const std::map<const MachineBasicBlock*, int>& depth) {
+        for (auto& obj : mf.frameObjects) obj.weight = 0;
+        for (const auto& block : mf.blocks) {
+            auto found = depth.find(block.get());
+            double w = 1;
+            for (int d = found == depth.end() ? 0 : std::min(found->second, 8); d > 0; --d) w *= 10;
+            for (const auto& mi : block->insts) {
+                for (const auto& op : mi.ops) {
+                    if (op.isFrameIndex()) mf.frameObjects[op.value].weight += w;
+                }
+            }
+        }
+    }
+};
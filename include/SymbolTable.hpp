@@ -1,9 +1,11 @@
 #pragma once
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <stdexcept>
 #include <vector>
 #include <list>
+#include <algorithm>
 #include "ir.hpp"
 struct SymbolInfo {
     enum Kind { CONST, VAR, FUNC } kind;
@@ -19,6 +21,7 @@ struct SymbolInfo {
     int array_size = 0;              
     int const_value = 0; 
     std::vector<int> array_dims;   // 新增：记录每一维长度  
+    const SparseInit* const_values = nullptr;  // 常量数组的初始值，属于对应的 GlobalAlloc
 
 
     static SymbolInfo makeConst(int value) {
@@ -28,16 +31,25 @@ struct SymbolInfo {
         return info;
     }
 
-    static SymbolInfo makeConstArray(Value* alloc, int size, const std::vector<int>& dims) {
+    static SymbolInfo makeConstArray(Value* alloc, int size, const std::vector<int>& dims,
+                                     const SparseInit* values) {
         SymbolInfo info;
         info.kind = CONST;
         info.is_array = true;
         info.array_size = size;
         info.array_dims = dims;
         info.var_alloc = alloc;
+        info.const_values = values;
         return info;
     }
 
+    // 常量数组展平后第 flat 个元素的值
+    int constElement(int flat) const {
+        auto it = std::lower_bound(const_values->begin(), const_values->end(), flat,
+                                   [](const std::pair<int, int>& e, int x) { return e.first < x; });
+        return it != const_values->end() && it->first == flat ? it->second : 0;
+    }
+
     static SymbolInfo makeVar(Value* alloc, bool is_arr = false, int size = 0,
                           const std::vector<int>& dims = {}, bool is_param = false) {
     SymbolInfo info;
@@ -62,6 +74,7 @@ class SymbolTable{
     private:
     std::list<std::unordered_map<std::string,SymbolInfo>> scopes;
     std::unordered_map<std::string,int> nameCount;
+    std::unordered_set<std::string> takenNames;//全局变量、函数名和已经生成过的名字，不带 '@'
     public:
     SymbolTable(){
         //全局作用域
@@ -77,9 +90,17 @@ class SymbolTable{
         }
         scopes.pop_back();
     }
+    // 名字和用户写的全局变量、函数同名时跳过这个编号，不管它们声明在前还是在后
     std::string makeUniqueName(const std::string& name){
-        int count =nameCount[name]++;
-        return "@"+name+"_"+std::to_string(count);
+        std::string unique;
+        do {
+            int count =nameCount[name]++;
+            unique = name+"_"+std::to_string(count);
+        } while (!takenNames.insert(unique).second);
+        return "@"+unique;
+    }
+    void reserveName(const std::string& name){
+        takenNames.insert(name);
     }
     void insertConst(const std::string& name,int value){
         auto &current = scopes.back();
@@ -101,12 +122,12 @@ class SymbolTable{
 
     //数组常量
     void insertConstArray(const std::string& name, Value* alloc, int size,
-                      const std::vector<int>& dims) {
+                      const std::vector<int>& dims, const SparseInit* values) {
     auto &current = scopes.back();
     if(current.find(name) != current.end()) {
         throw std::runtime_error("Constant array " + name + " already defined.");
     }
-    current[name] = SymbolInfo::makeConstArray(alloc, size, dims);
+    current[name] = SymbolInfo::makeConstArray(alloc, size, dims, values);
 }
 
     const SymbolInfo& lookup(const std::string& name) const {
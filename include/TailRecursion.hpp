@@ -0,0 +1,118 @@
+#pragma once
+#include "ir.hpp"
+#include <iterator>
+#include <map>
+#include <vector>
+
+// 局部变量的地址有没有流出去（被 getelemptr/getptr 拿去算地址、当参数传出去或被存起来）
+// 有的话当前栈帧在尾调用之后还可能被访问，不能拆掉栈帧，也不能复用同一份栈上的数组
+inline bool hasEscapingAlloc(const Function& func) {
+    for (const auto& block : func.blocks) {
+        for (const auto& inst : block->insts) {
+            if (inst->op == OpType::Load) continue;
+            const auto ops = inst->operands();
+            for (size_t i = 0; i < ops.size(); ++i) {
+                auto alloc = dynamic_cast<const Instruction*>(ops[i]);
+                if (!alloc || alloc->op != OpType::Alloc) continue;
+                if (inst->op == OpType::Store && i == 1) continue;  // store 的地址
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// call 紧跟着 ret 它的结果（或者 void 的 ret），就是尾调用
+inline bool isTailCall(const Instruction& call, const Instruction& next) {
+    if (call.op != OpType::Call || next.op != OpType::Ret) return false;
+    const auto& ret = static_cast<const ReturnInst&>(next);
+    return ret.retValue == nullptr || ret.retValue == &call;
+}
+
+// 自尾递归改成循环：
+//   entry 里参数的 alloc + store 之后切出一个新块 %tailrec_body，
+//   call @f(args); ret  换成  store args 到参数的 alloc; jump %tailrec_body
+// 标量参数只通过它的 alloc 使用；数组参数没有 alloc，只能原样传回自己
+class TailRecursionElimination {
+public:
+    bool run(Program& prog) {
+        bool changed = false;
+        for (auto& func : prog.funcs) {
+            changed |= run(*func);
+        }
+        return changed;
+    }
+
+    bool run(Function& func) {
+        if (func.blocks.empty() || hasEscapingAlloc(func)) return false;
+
+        std::vector<BasicBlock*> sites;
+        for (auto& block : func.blocks) {
+            if (block->insts.size() < 2) continue;
+            auto last = std::prev(block->insts.end());
+            auto call = std::prev(last);
+            if (isTailCall(**call, **last) && static_cast<CallInst&>(**call).funcName == func.name) {
+                sites.push_back(block.get());
+            }
+        }
+        if (sites.empty()) return false;
+
+        // 参数 i 对应的 alloc；数组参数是 nullptr
+        BasicBlock* entry = func.blocks.front().get();
+        std::map<std::string, AllocInst*> paramAlloc;
+        std::map<std::string, int> paramUses;
+        auto splitPoint = entry->insts.begin();
+        for (auto it = entry->insts.begin(); it != entry->insts.end(); ++it) {
+            if ((*it)->op == OpType::Store) {
+                auto store = static_cast<StoreInst*>(it->get());
+                auto alloc = dynamic_cast<AllocInst*>(store->address);
+                if (dynamic_cast<Parameter*>(store->value) && alloc) {
+                    paramAlloc[store->value->name] = alloc;
+                    splitPoint = std::next(it);
+                }
+            }
+        }
+        for (auto& block : func.blocks) {
+            for (auto& inst : block->insts) {
+                for (Value* op : inst->operands()) {
+                    if (dynamic_cast<Parameter*>(op)) paramUses[op->name]++;
+                }
+            }
+        }
+        for (size_t i = 0; i < func.params.size(); ++i) {
+            const std::string& name = func.params[i].first;
+            if (paramAlloc.count(name)) {
+                if (paramUses[name] != 1) return false;  // 标量参数除了存进 alloc 还有别的用处
+                continue;
+            }
+            // 数组参数：每个尾递归点都得把它原样传回来
+            for (BasicBlock* site : sites) {
+                auto call = static_cast<CallInst*>(std::prev(site->insts.end(), 2)->get());
+                if (call->args[i]->name != name) return false;
+            }
+        }
+
+        // 把 entry 切开，参数初始化之后的部分成为循环的入口
+        auto body = new BasicBlock("%tailrec_body");
+        body->insts.splice(body->insts.end(), entry->insts, splitPoint, entry->insts.end());
+        entry->addInst(new JumpInst(body));
+        func.blocks.insert(std::next(func.blocks.begin()), std::unique_ptr<BasicBlock>(body));
+        func.invalidateCFG();
+
+        for (BasicBlock* site : sites) {
+            if (site == entry) site = body;
+            auto last = std::prev(site->insts.end());
+            auto call = static_cast<CallInst*>(std::prev(last)->get());
+            std::vector<Value*> args = call->args;
+            site->insts.erase(std::prev(last), site->insts.end());
+            for (size_t i = 0; i < func.params.size(); ++i) {
+                auto alloc = paramAlloc.find(func.params[i].first);
+                if (alloc != paramAlloc.end()) {
+                    site->addInst(new StoreInst(args[i], alloc->second));
+                }
+            }
+            site->addInst(new JumpInst(body));
+        }
+        return true;
+    }
+};
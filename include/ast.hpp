@@ -183,6 +183,9 @@ class MulExpAST: public BaseAST{
         else if (mul_exp && unary_exp) {
             int left = mul_exp->evalConst(sym_table);
             int right = unary_exp->evalConst(sym_table);
+            if (mul_op != '*' && right == 0) {
+                throw std::runtime_error("Division by zero in constant expression");
+            }
             if (mul_op == '*') {
                 return left * right;
             } else if (mul_op == '/') {
@@ -363,9 +366,25 @@ class LValAST: public BaseAST{
     std::string ident;
     std::vector<std::unique_ptr<BaseAST>> indices; // 多维数组访问下标
     int evalConst(SymbolTable& sym_table) const override {
-        if (!indices.empty() || sym_table.lookup(ident).is_array) {
-        //常量表达式里不能有数组解引用
-        throw std::runtime_error("Dereferencing constant array is not allowed in constant expressions.");
+        const SymbolInfo& info = sym_table.lookup(ident);
+        if (info.kind == SymbolInfo::CONST && info.is_array) {
+            // 常量数组用常量下标取到单个元素时，值在编译期就知道
+            if (indices.size() != info.array_dims.size()) {
+                throw std::runtime_error("Constant array " + ident + " must be fully indexed in constant expressions.");
+            }
+            int flat = 0;
+            for (size_t i = 0; i < indices.size(); ++i) {
+                int idx = indices[i]->evalConst(sym_table);
+                if (idx < 0 || idx >= info.array_dims[i]) {
+                    throw std::runtime_error("Index out of range for constant array " + ident + ".");
+                }
+                flat = flat * info.array_dims[i] + idx;
+            }
+            return info.constElement(flat);
+        }
+        if (!indices.empty() || info.is_array) {
+        //常量表达式里不能有变量数组解引用
+        throw std::runtime_error("Dereferencing array is not allowed in constant expressions.");
     }
     // 只有普通的 const int a = 10; 这种标量常量才允许求值
     return sym_table.lookupConst(ident);
@@ -27,6 +27,17 @@ static int find_aligned_dim(int cur_dim, int used, const vector<int>& blocks) {
     return -1;
 }
 
+// 放下第 pos 个元素，只记非 0 的值；pos 单调增加，结果自然按偏移有序
+static void put_value(SparseInit& data, int& pos, int total, int value) {
+    if (pos >= total) {
+        throw runtime_error("too many initializers");
+    }
+    if (value != 0) {
+        data.push_back({pos, value});
+    }
+    pos++;
+}
+
 //填充一维数组，递归
 static void flatten_impl(
     InitValAST* init,
@@ -34,7 +45,7 @@ static void flatten_impl(
     int& pos,
     const vector<int>& dims,
     const vector<int>& blocks,
-    vector<int>& data,
+    SparseInit& data,
     SymbolTable& sym
 ) {
     int n = (int)dims.size();
@@ -44,19 +55,13 @@ static void flatten_impl(
         if (init->is_list) {
             throw runtime_error("brace initializer for scalar");
         }
-        if (pos >= (int)data.size()) {
-            throw runtime_error("too many initializers");
-        }
-        data[pos++] = init->exp->evalConst(sym);
+        put_value(data, pos, blocks[0], init->exp->evalConst(sym));
         return;
     }
 
     // 当前是一个单表达式
     if (!init->is_list) {
-        if (pos >= (int)data.size()) {
-            throw runtime_error("too many initializers");
-        }
-        data[pos++] = init->exp->evalConst(sym);
+        put_value(data, pos, blocks[0], init->exp->evalConst(sym));
         return;
     }
 
@@ -75,7 +80,7 @@ static void flatten_impl(
         }
 
         if (!elem->is_list) {
-            data[pos++] = elem->exp->evalConst(sym);
+            put_value(data, pos, end, elem->exp->evalConst(sym));
         } else {
             int used = pos - begin;
             int next_dim = find_aligned_dim(dim, used, blocks);
@@ -91,7 +96,7 @@ static void flatten_impl(
 }
 
 //总入口函数
-vector<int> flatten_init(
+SparseInit flatten_init(
     InitValAST* init,
     const vector<int>& dims,
     SymbolTable& sym
@@ -104,7 +109,7 @@ vector<int> flatten_init(
     }
 
     vector<int> blocks = build_blocks(dims);
-    vector<int> data(blocks[0], 0);
+    SparseInit data;
 
     int pos = 0;
     flatten_impl(init, 0, pos, dims, blocks, data, sym);
@@ -118,7 +123,7 @@ static void flatten_const_impl(
     int& pos,
     const vector<int>& dims,
     const vector<int>& blocks,
-    vector<int>& data,
+    SparseInit& data,
     SymbolTable& sym
 ) {
     int n = (int)dims.size();
@@ -127,18 +132,12 @@ static void flatten_const_impl(
         if (init->is_list) {
             throw runtime_error("brace initializer for scalar");
         }
-        if (pos >= (int)data.size()) {
-            throw runtime_error("too many initializers");
-        }
-        data[pos++] = init->const_exp->evalConst(sym);
+        put_value(data, pos, blocks[0], init->const_exp->evalConst(sym));
         return;
     }
 
     if (!init->is_list) {
-        if (pos >= (int)data.size()) {
-            throw runtime_error("too many initializers");
-        }
-        data[pos++] = init->const_exp->evalConst(sym);
+        put_value(data, pos, blocks[0], init->const_exp->evalConst(sym));
         return;
     }
 
@@ -156,7 +155,7 @@ static void flatten_const_impl(
         }
 
         if (!elem->is_list) {
-            data[pos++] = elem->const_exp->evalConst(sym);
+            put_value(data, pos, end, elem->const_exp->evalConst(sym));
         } else {
             int used = pos - begin;
             int next_dim = find_aligned_dim(dim, used, blocks);
@@ -170,7 +169,7 @@ static void flatten_const_impl(
     pos = end;
 }
 
-vector<int> flatten_const_init(
+SparseInit flatten_const_init(
     ConstInitValAST* init, 
     const vector<int>& dims, 
     SymbolTable& sym
@@ -183,7 +182,7 @@ vector<int> flatten_const_init(
     }
 
     vector<int> blocks = build_blocks(dims);
-    vector<int> data(blocks[0], 0);
+    SparseInit data;
 
     int pos = 0;
     flatten_const_impl(init, 0, pos, dims, blocks, data, sym);
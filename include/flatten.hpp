@@ -2,14 +2,16 @@
 #include <vector>
 #include "ast.hpp"
 #include "SymbolTable.hpp"
+#include "ir.hpp"
 
-std::vector<int> flatten_init(
+// 只返回非 0 的元素，见 SparseInit
+SparseInit flatten_init(
     InitValAST* init,
     const std::vector<int>& dims,
     SymbolTable& sym
 );
 
-std::vector<int> flatten_const_init(
+SparseInit flatten_const_init(
     ConstInitValAST* init, 
     const std::vector<int>& dims, 
     SymbolTable& sym
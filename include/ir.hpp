@@ -1,9 +1,11 @@
 #pragma once
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <string>
 #include <ostream>
 #include <list>
+#include <utility>
 
 /*
 Program
@@ -93,21 +95,25 @@ public:
     virtual bool isGlobal() const { return false; }
 };
 
+// 数组初始值的稀疏表示：按偏移升序排列的 (偏移, 值)，只记非 0 的元素，其余都是 0
+using SparseInit = std::vector<std::pair<int, int>>;
+
 //全局变量
 class GlobalAlloc : public Value {
 public:
     int size;               // 数组长度，1 表示标量
-    std::vector<int> values; // 存储初始值列表
+    SparseInit values;      // 非 0 的初始值
     bool isArray;
+    bool isConst = false;   // 常量数组，放进只读数据段
 
     bool isGlobal() const override { return true; }
     GlobalAlloc(const std::string& n, int v) : size(1), isArray(false) {
         name = n;
-        values.push_back(v);
+        if (v != 0) values.push_back({0, v});
         type = Type::Int32;
     }
-    GlobalAlloc(const std::string& n, const std::vector<int>& v, int s) 
-        : size(s), values(v), isArray(true) {
+    GlobalAlloc(const std::string& n, SparseInit v, int s)
+        : size(s), values(std::move(v)), isArray(true) {
         name = n;
         type = Type::Int32;
     }
@@ -115,19 +121,25 @@ public:
     std::string toString() const override {
         std::string typeStr = isArray ? "[i32, " + std::to_string(size) + "]" : "i32";
         std::string res = "global " + name + " = alloc " + typeStr + ", ";
-        bool allZero = true;
-        for(int v : values) if(v != 0) { allZero = false; break; }
 
-        if (allZero) {
+        if (values.empty()) {
             res += "zeroinit";
         } 
         else if (!isArray) {
-            res += std::to_string(values[0]);
+            res += std::to_string(values[0].second);
         } 
         else {
+            // Koopa 的聚合初始值必须逐个写出，没记下的元素补 0
+            res.reserve(res.size() + size * 3);
             res += "{";
-            for (size_t i = 0; i < values.size(); ++i) {
-                res += std::to_string(values[i]) + (i == values.size() - 1 ? "" : ", ");
+            size_t next = 0;
+            for (int i = 0; i < size; ++i) {
+                if (i > 0) res += ", ";
+                if (next < values.size() && values[next].first == i) {
+                    res += std::to_string(values[next++].second);
+                } else {
+                    res += '0';
+                }
             }
             res += "}";
         }
@@ -162,6 +174,20 @@ public:
     }
 };
 
+// 基本块参数，代替 phi：块的每个前驱跳过来时各自带上一个值
+class BlockArg : public Value {
+public:
+    BasicBlock* parent;
+    BlockArg(const std::string& n, Type t, BasicBlock* block) : parent(block) {
+        name = n;
+        type = t;
+    }
+
+    std::string toString() const override {
+        return name;
+    }
+};
+
 class Instruction: public Value {
 public:
     OpType op;
@@ -171,24 +197,52 @@ public:
         type = t;
         name = n;
     }
+    // 指令读取的操作数（不含基本块）
+    virtual std::vector<Value*> operands() const { return {}; }
+    // 把读取的 from 都换成 to
+    virtual void replaceOperand(Value* from, Value* to) {}
 };
 
+inline void replaceIn(Value*& slot, Value* from, Value* to) {
+    if (slot == from) slot = to;
+}
+
+inline void replaceIn(std::vector<Value*>& slots, Value* from, Value* to) {
+    for (Value*& slot : slots) replaceIn(slot, from, to);
+}
+
 class BranchInst : public Instruction {
 public:
     Value* condition;
     BasicBlock* thenBlock;
     BasicBlock* elseBlock;
+    std::vector<Value*> thenArgs;
+    std::vector<Value*> elseArgs;
 
     BranchInst(Value* cond, BasicBlock* thenB, BasicBlock* elseB)
         : Instruction(OpType::Br, Type::Void, ""), condition(cond), thenBlock(thenB), elseBlock(elseB) {}
+    std::vector<Value*> operands() const override {
+        std::vector<Value*> ops{condition};
+        ops.insert(ops.end(), thenArgs.begin(), thenArgs.end());
+        ops.insert(ops.end(), elseArgs.begin(), elseArgs.end());
+        return ops;
+    }
+    void replaceOperand(Value* from, Value* to) override {
+        replaceIn(condition, from, to);
+        replaceIn(thenArgs, from, to);
+        replaceIn(elseArgs, from, to);
+    }
     std::string toString() const override ;
 };
 
 class JumpInst : public Instruction {
 public:
     BasicBlock* targetBlock;
-    JumpInst(BasicBlock* target)
-        : Instruction(OpType::Jump, Type::Void, ""), targetBlock(target) {}
+    std::vector<Value*> args;
+    JumpInst(BasicBlock* target, std::vector<Value*> arguments = {})
+        : Instruction(OpType::Jump, Type::Void, ""), targetBlock(target), args(std::move(arguments)) {}
+    std::vector<Value*> operands() const override { return args; }
+    void replaceOperand(Value* from, Value* to) override { replaceIn(args, from, to); }
     std::string toString() const override ;
 };
 
@@ -198,6 +252,11 @@ public:
     Value* rhs;
     Binary(OpType operation, Value* l, Value* r, const std::string& n)
         : Instruction(operation, Type::Int32, n), lhs(l), rhs(r) {}
+    std::vector<Value*> operands() const override { return {lhs, rhs}; }
+    void replaceOperand(Value* from, Value* to) override {
+        replaceIn(lhs, from, to);
+        replaceIn(rhs, from, to);
+    }
 
     std::string toString() const override {
        return name + " = " + opName(op) + " " + lhs->name + ", " + rhs->name;
@@ -209,6 +268,11 @@ public:
     Value* retValue;
     ReturnInst(Value* v = nullptr) 
         : Instruction(OpType::Ret, Type::Void, ""), retValue(v) {}
+    std::vector<Value*> operands() const override {
+        if (!retValue) return {};
+        return {retValue};
+    }
+    void replaceOperand(Value* from, Value* to) override { replaceIn(retValue, from, to); }
 
     std::string toString() const override {
         if (!retValue) return "ret";
@@ -242,6 +306,11 @@ public:
     GetElemPtrInst(Value* p, Value* idx, const std::string& n)
         : Instruction(OpType::GetElemPtr, Type::Pointer, n), ptr(p), index(idx) {
     }
+    std::vector<Value*> operands() const override { return {ptr, index}; }
+    void replaceOperand(Value* from, Value* to) override {
+        replaceIn(ptr, from, to);
+        replaceIn(index, from, to);
+    }
 
     std::string toString() const override {
         //%1 = getelemptr @arr, %idxm
@@ -256,6 +325,11 @@ public:
     StoreInst(Value* val, Value* addr)
         : Instruction(OpType::Store, Type::Void, ""), value(val), address(addr) {
         } 
+    std::vector<Value*> operands() const override { return {value, address}; }
+    void replaceOperand(Value* from, Value* to) override {
+        replaceIn(value, from, to);
+        replaceIn(address, from, to);
+    }
     std::string toString() const override {
         return "store " + value->name + ", " + address->name;
     }
@@ -266,6 +340,8 @@ public:
     LoadInst(Value* addr, const std::string& n)
         : Instruction(OpType::Load, Type::Int32, n), address(addr) {
         } 
+    std::vector<Value*> operands() const override { return {address}; }
+    void replaceOperand(Value* from, Value* to) override { replaceIn(address, from, to); }
     std::string toString() const override {
         return name + " = load " + address->name;
     }
@@ -276,6 +352,8 @@ public:
     std::vector<Value*> args;
     CallInst(const std::string& fName, const std::vector<Value*>& arguments, Type retType, const std::string& n)
         : Instruction(OpType::Call, retType, n), funcName(fName), args(arguments) {}
+    std::vector<Value*> operands() const override { return args; }
+    void replaceOperand(Value* from, Value* to) override { replaceIn(args, from, to); }
 
     std::string toString() const override {
         std::string res = (type == Type::Void ? "" : name + " = ") + "call " + funcName + "(";
@@ -293,6 +371,11 @@ public:
 
     GetPtrInst(Value* p, Value* idx, const std::string& n)
         : Instruction(OpType::GetPtr, Type::Pointer, n), ptr(p), index(idx) {}
+    std::vector<Value*> operands() const override { return {ptr, index}; }
+    void replaceOperand(Value* from, Value* to) override {
+        replaceIn(ptr, from, to);
+        replaceIn(index, from, to);
+    }
 
     std::string toString() const override {
         return name + " = getptr " + ptr->name + ", " + index->name;
@@ -303,6 +386,8 @@ class BasicBlock : public Value {
 public:
     std::list<std::unique_ptr<Instruction>> insts;
     std::list<std::unique_ptr<Value>> values; 
+    std::vector<BlockArg*> args;  // 块参数，归 values 所有
+    std::vector<BasicBlock*> preds, succs;  // CFG 边，由 Function::updateCFG() 建立并维护
     BasicBlock(const std::string &n) {name=n;type=Type::Label;}
     void addInst(Instruction* inst) {
         insts.push_back(std::unique_ptr<Instruction>(inst));
@@ -310,8 +395,22 @@ public:
     void addValue(Value* val) {
         values.push_back(std::unique_ptr<Value>(val));
     }
+    BlockArg* addArg(const std::string& n, Type t) {
+        auto arg = new BlockArg(n, t, this);
+        addValue(arg);
+        args.push_back(arg);
+        return arg;
+    }
     std::string toString() const override {
-        std::string result = name + ":\n";
+        std::string result = name;
+        if (!args.empty()) {
+            result += "(";
+            for (size_t i = 0; i < args.size(); ++i) {
+                result += args[i]->name + (args[i]->type == Type::Pointer ? ": *i32" : ": i32");
+                result += i + 1 == args.size() ? ")" : ", ";
+            }
+        }
+        result += ":\n";
         for (const auto& inst : insts) {
             result += "  " + inst->toString() + "\n";
         }
@@ -323,6 +422,7 @@ public:
     std::list<std::unique_ptr<BasicBlock>> blocks;
     std::vector<std::pair<std::string, Type>> params; // 存储参数名和类型
     Type retType;
+    unsigned cfgEpoch = 0;  // CFG 每改一次加一，支配树之类的分析靠它判断自己过没过期
 
     Function(const std::string &n, Type rt) : retType(rt) {
         name = n;
@@ -333,6 +433,19 @@ public:
         blocks.push_back(std::unique_ptr<BasicBlock>(block));
     }
 
+    // 增删块、改终结指令的目标之后调用；块上的 preds/succs 等到下次 updateCFG() 再重建
+    void invalidateCFG() {
+        edgesValid = false;
+        ++cfgEpoch;
+    }
+    // 按终结指令重建所有块的 preds/succs，已经是最新的就什么都不做
+    void updateCFG();
+    // 把 block 的终结指令里跳到 from 的目标都改成 to，边表就地更新
+    void replaceSuccessor(BasicBlock* block, BasicBlock* from, BasicBlock* to);
+    // 删掉一个块并断开它的边；调用前不应再有留下来的块跳到它
+    // 它拥有的常数之类的值可能还被别的块用着，所有权交给入口
+    void removeBlock(BasicBlock* block);
+
     std::string toString() const override {
     std::string result = "fun " + name + "(";
     for (size_t i = 0; i < params.size(); ++i) {
@@ -355,6 +468,9 @@ public:
     result += "}\n";
     return result;
 }
+
+private:
+    bool edgesValid = false;
 };
 
 class Program {
@@ -398,10 +514,98 @@ public:
 
 
 
+// 跳转目标后面带的实参，"%bb(%a, %b)"
+inline std::string blockRef(const BasicBlock* block, const std::vector<Value*>& args) {
+    std::string res = block->name;
+    if (!args.empty()) {
+        res += "(";
+        for (size_t i = 0; i < args.size(); ++i) {
+            res += args[i]->name + (i + 1 == args.size() ? ")" : ", ");
+        }
+    }
+    return res;
+}
+
 inline std::string BranchInst::toString() const {
-    return "br " + condition->name + ", " + thenBlock->name + ", " + elseBlock->name;
+    return "br " + condition->name + ", " + blockRef(thenBlock, thenArgs) + ", " + blockRef(elseBlock, elseArgs);
 }
 
 inline std::string JumpInst::toString() const {
-    return "jump " + targetBlock->name;
-}
\ No newline at end of file
+    return "jump " + blockRef(targetBlock, args);
+}
+
+inline std::vector<BasicBlock*> successorsOf(const BasicBlock& block) {
+    if (block.insts.empty()) {
+        return {};
+    }
+    const Instruction* term = block.insts.back().get();
+    if (term->op == OpType::Br) {
+        auto br = static_cast<const BranchInst*>(term);
+        return {br->thenBlock, br->elseBlock};
+    }
+    if (term->op == OpType::Jump) {
+        return {static_cast<const JumpInst*>(term)->targetBlock};
+    }
+    return {};
+}
+
+// 地址一路沿 getelemptr/getptr 往回找到的对象：局部数组的 alloc、全局变量，或者数组参数
+inline const Value* baseObject(const Value* addr) {
+    while (true) {
+        if (auto gep = dynamic_cast<const GetElemPtrInst*>(addr)) addr = gep->ptr;
+        else if (auto gp = dynamic_cast<const GetPtrInst*>(addr)) addr = gp->ptr;
+        else return addr;
+    }
+}
+
+inline void Function::updateCFG() {
+    if (edgesValid) return;
+    for (auto& block : blocks) {
+        block->preds.clear();
+        block->succs.clear();
+    }
+    for (auto& block : blocks) {
+        block->succs = successorsOf(*block);
+        for (BasicBlock* s : block->succs) s->preds.push_back(block.get());
+    }
+    edgesValid = true;
+}
+
+inline void Function::replaceSuccessor(BasicBlock* block, BasicBlock* from, BasicBlock* to) {
+    Instruction* term = block->insts.back().get();
+    if (term->op == OpType::Br) {
+        auto br = static_cast<BranchInst*>(term);
+        if (br->thenBlock == from) br->thenBlock = to;
+        if (br->elseBlock == from) br->elseBlock = to;
+    } else if (term->op == OpType::Jump) {
+        auto jump = static_cast<JumpInst*>(term);
+        if (jump->targetBlock == from) jump->targetBlock = to;
+    }
+    ++cfgEpoch;
+    if (!edgesValid) return;
+    for (BasicBlock*& s : block->succs) {
+        if (s != from) continue;
+        s = to;
+        from->preds.erase(std::find(from->preds.begin(), from->preds.end(), block));
+        to->preds.push_back(block);
+    }
+}
+
+inline void Function::removeBlock(BasicBlock* block) {
+    if (edgesValid) {
+        for (BasicBlock* s : block->succs) {
+            s->preds.erase(std::find(s->preds.begin(), s->preds.end(), block));
+        }
+        for (BasicBlock* p : block->preds) {
+            p->succs.erase(std::remove(p->succs.begin(), p->succs.end(), block), p->succs.end());
+        }
+    }
+    ++cfgEpoch;
+    BasicBlock* entry = blocks.front().get();
+    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+        if (it->get() != block) continue;
+        if (block != entry) entry->values.splice(entry->values.end(), block->values);
+        blocks.erase(it);
+        return;
+    }
+}
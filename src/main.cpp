@@ -9,6 +9,12 @@
 #include "../include/IRGenerator.hpp"
 #include "../include/ir.hpp"
 #include "../include/RISCVGenerator.hpp"
+#include "../include/TailRecursion.hpp"
+#include "../include/AddressSinking.hpp"
+#include "../include/Mem2Reg.hpp"
+#include "../include/SCCP.hpp"
+#include "../include/GVN.hpp"
+#include "../include/DCE.hpp"
 //#include "../include/rv_gen.hpp"
 using namespace std;
 
@@ -18,13 +24,23 @@ extern int yyparse(unique_ptr<BaseAST> &ast);
 int main(int argc, const char *argv[]) {
   if (argc < 5) {
     std::cerr << "Usage: " << argv[0] << " -koopa <input_file> -o <output_file>" << std::endl;
-    std::cerr << "       "<< argv[0] << " -riscv <input_file> -o <output_file>" << std::endl;
+    std::cerr << "       "<< argv[0] << " -riscv <input_file> -o <output_file> [-O2] [-stats]" << std::endl;
     return 1;
   }
 
   auto mode = std::string(argv[1]);
   auto input = argv[2];
   auto output = argv[4];
+  int optLevel = 0;
+  bool printStats = false;
+  for (int i = 5; i < argc; ++i) {
+    if (std::string(argv[i]) == "-O2") {
+      optLevel = 2;
+    }
+    else if (std::string(argv[i]) == "-stats") {
+      printStats = true;
+    }
+  }
 
   yyin = fopen(input, "r");
   assert(yyin);
@@ -45,13 +61,29 @@ int main(int argc, const char *argv[]) {
   }
 
   if (mode == "-koopa") {
+    Mem2Reg().run(*koopa_program);
+    SCCP().run(*koopa_program);
+    GVN().run(*koopa_program);
+    DeadCodeElimination().run(*koopa_program);
     koopa_program->toString(output_file);
     std::cout << "Successfully generated Koopa IR to " << output << std::endl;
   } 
   else if (mode == "-riscv") {
+    TailRecursionElimination().run(*koopa_program);
+    Mem2Reg().run(*koopa_program);
+    SCCP().run(*koopa_program);
+    GVN().run(*koopa_program);
+    DeadCodeElimination().run(*koopa_program);
+    AddressSinking().run(*koopa_program);
     RISCVGenerator riscv_generator;
+    riscv_generator.optLevel = optLevel;
     std::string riscv_code = riscv_generator.generate(*koopa_program);
     output_file << riscv_code;
+    if (printStats) {
+      for (const auto& stat : riscv_generator.peepholeStats) {
+        std::cerr << "peephole: " << stat.first << " removed " << stat.second << " instructions" << std::endl;
+      }
+    }
     std::cout << "Successfully generated RISCV assembly to " << output << std::endl;
   }
   else {